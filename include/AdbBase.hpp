@@ -3,6 +3,7 @@
 
 #include "Transport.hpp"
 #include "Features.hpp"
+#include "AdbPacketHandler.hpp"
 
 
 class AdbBase {
@@ -15,6 +16,7 @@ public:
     using ErrorListener  = std::function<void(int /*errorCode*/, const APacket*, bool /*incoming package*/)>;
 
     using UniqueTransport = Transport::UniquePointer;
+    using SendCompletion = Transport::Completion;
     using Arg = uint32_t;
 
     enum AuthType {
@@ -42,13 +44,14 @@ public: // Util
     [[nodiscard]] bool checkPacketValidity(const APacket& packet) const;
 
 public: // Send
-    void sendConnect(const std::string& systemType, const FeatureSet& featureSet);
-    void sendTls(Arg type, Arg version);
-    void sendAuth(AuthType type, APayload payload);
-    void sendOpen(Arg localStreamId, APayload payload);
-    void sendReady(Arg localStreamId, Arg remoteStreamId);
-    void sendWrite(Arg localStreamId, Arg remoteStreamId, APayload payload);
-    void sendClose(Arg localStreamId, Arg remoteStreamId);
+    // Every send accepts an optional completion that is called when that packet leaves the transport
+    void sendConnect(const std::string& systemType, const FeatureSet& featureSet, SendCompletion completion = {});
+    void sendTls(Arg type, Arg version, SendCompletion completion = {});
+    void sendAuth(AuthType type, APayload payload, SendCompletion completion = {});
+    void sendOpen(Arg localStreamId, APayload payload, SendCompletion completion = {});
+    void sendReady(Arg localStreamId, Arg remoteStreamId, SendCompletion completion = {});
+    void sendWrite(Arg localStreamId, Arg remoteStreamId, APayload payload, SendCompletion completion = {});
+    void sendClose(Arg localStreamId, Arg remoteStreamId, SendCompletion completion = {});
 
     static APayload makeConnectionString(const std::string_view& systemType,
                                          const std::string_view& serial,
@@ -56,7 +59,12 @@ public: // Send
 
 public: // Incoming packets
     void setPacketListener(PacketListener);
-    void resetPacketListener();
+    void resetPacketListener(); // resets the packet handler too
+
+    // Statically dispatched alternative to the PacketListener, see AdbPacketHandler.
+    // The handler receives transport errors of incoming packets too
+    template <class Handler>
+    void setPacketHandler(AdbPacketHandler<Handler>& handler);
 
 public: // Errors
     void setErrorListener(ErrorListener);
@@ -68,15 +76,40 @@ protected:
     AdbBase(AdbBase&& other) noexcept;
 
     void setup();
+    bool startTls(const Transport::TlsConfig& config);
 
 private:
+    template <class Handler>
+    static void staticReceive(void* base, APacket* packet, Transport::ErrorCode errorCode);
+
     uint32_t mVersion;
     UniqueTransport mTransport;
 
     PacketListener mPacketListener;
+    void* mPacketHandler = nullptr; // AdbPacketHandler<Handler>*, type is known to staticReceive<Handler>
     ErrorListener mErrorListener;
     bool mReportSuccessfulSends;
 };
 
+template <class Handler>
+void AdbBase::setPacketHandler(AdbPacketHandler<Handler>& handler)
+{
+    mPacketHandler = &handler;
+    mTransport->setRawReceiveListener(&AdbBase::staticReceive<Handler>, this);
+}
+
+template <class Handler>
+void AdbBase::staticReceive(void* base, APacket* packet, Transport::ErrorCode errorCode)
+{
+    auto* self = static_cast<AdbBase*>(base);
+    auto* handler = static_cast<AdbPacketHandler<Handler>*>(self->mPacketHandler);
+
+    if (errorCode == Transport::OK)
+        handler->dispatch(*packet);
+    else
+        handler->dispatchError(errorCode, packet, true);
+
+    self->mTransport->receive();
+}
 
 #endif //ADB_LIB_ADBBASE_HPP
@@ -0,0 +1,307 @@
+#ifndef ADB_LIB_ADBCORO_HPP
+#define ADB_LIB_ADBCORO_HPP
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <memory>
+#include <optional>
+#include <utility>
+
+#include "AdbDevice.hpp"
+#include "ThreadPool.hpp"
+
+
+// C++20 coroutines over the asynchronous device and stream API (adblib_coro target).
+// Awaitables never block a thread: transports complete them from their event threads,
+// the coroutine then continues on the executor, never on the event thread itself.
+//
+//     AdbCoro::Task<size_t> countBytes(AdbCoro::Executor& executor, AdbDevice::SharedPointer device) {
+//         auto streams = co_await AdbCoro::open(executor, device, "shell:ls");
+//         size_t bytes = 0;
+//         while (auto payload = co_await AdbCoro::read(executor, streams->istream))
+//             bytes += payload->getSize();
+//         co_return bytes;
+//     }
+//     auto bytes = AdbCoro::syncWait(executor, countBytes(executor, device));
+namespace AdbCoro {
+
+    // Coroutines resume on its threads
+    class Executor {
+    public:
+        explicit Executor(size_t threadCount);
+        Executor(const Executor&) = delete;
+
+        void post(std::coroutine_handle<> handle); // resumes inline if the executor is stopped
+        void stop(); // finishes queued resumptions, joins threads
+
+        // co_await executor.schedule() moves the coroutine onto the executor
+        auto schedule()
+        {
+            struct Awaiter {
+                Executor& executor;
+                bool await_ready() const noexcept { return false; }
+                void await_suspend(std::coroutine_handle<> handle) { executor.post(handle); }
+                void await_resume() const noexcept {}
+            };
+            return Awaiter{*this};
+        }
+
+    private:
+        ThreadPool mPool;
+    };
+
+
+    // Lazy coroutine: starts when awaited, resumes the awaiting coroutine when done
+    template<class T = void>
+    class Task;
+
+    namespace detail {
+
+        // Resumes whoever awaits the finished task
+        struct FinalAwaiter {
+            bool await_ready() const noexcept { return false; }
+
+            template<class Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+            {
+                auto continuation = handle.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        struct PromiseBase {
+            std::coroutine_handle<> continuation;
+            std::exception_ptr exception;
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            FinalAwaiter final_suspend() noexcept { return {}; }
+
+            void unhandled_exception() { exception = std::current_exception(); }
+        };
+
+        template<class T>
+        struct Promise : PromiseBase {
+            std::optional<T> value;
+
+            Task<T> get_return_object();
+            void return_value(T result) { value.emplace(std::move(result)); }
+
+            T result()
+            {
+                if (exception)
+                    std::rethrow_exception(exception);
+                return std::move(*value);
+            }
+        };
+
+        template<>
+        struct Promise<void> : PromiseBase {
+            Task<void> get_return_object();
+            void return_void() {}
+
+            void result()
+            {
+                if (exception)
+                    std::rethrow_exception(exception);
+            }
+        };
+
+        // Runs a task to completion on its own, destroys itself at the end
+        struct Detached {
+            struct promise_type {
+                Detached get_return_object() { return {std::coroutine_handle<promise_type>::from_promise(*this)}; }
+                std::suspend_always initial_suspend() noexcept { return {}; }
+                std::suspend_never final_suspend() noexcept { return {}; }
+                void return_void() {}
+                void unhandled_exception() { std::terminate(); }
+            };
+
+            std::coroutine_handle<promise_type> handle;
+        };
+    }
+
+    template<class T>
+    class Task {
+    public:
+        using promise_type = detail::Promise<T>;
+        using Handle = std::coroutine_handle<promise_type>;
+
+        explicit Task(Handle handle) : mHandle(handle) {}
+        Task(Task&& other) noexcept : mHandle(std::exchange(other.mHandle, {})) {}
+        Task(const Task&) = delete;
+        ~Task() { if (mHandle) mHandle.destroy(); }
+
+        auto operator co_await() && noexcept
+        {
+            struct Awaiter {
+                Handle handle;
+                bool await_ready() const noexcept { return !handle || handle.done(); }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+                {
+                    handle.promise().continuation = awaiting;
+                    return handle; // symmetric transfer, no stack growth on long chains
+                }
+
+                T await_resume() { return handle.promise().result(); }
+            };
+            return Awaiter{mHandle};
+        }
+
+    private:
+        Handle mHandle;
+    };
+
+    template<class T>
+    Task<T> detail::Promise<T>::get_return_object()
+    {
+        return Task<T>{std::coroutine_handle<Promise<T>>::from_promise(*this)};
+    }
+
+    inline Task<void> detail::Promise<void>::get_return_object()
+    {
+        return Task<void>{std::coroutine_handle<Promise<void>>::from_promise(*this)};
+    }
+
+
+    // Starts the task on the executor without waiting for it. Exceptions terminate
+    inline void spawn(Executor& executor, Task<void> task)
+    {
+        auto detached = [] (Executor& executor, Task<void> task) -> detail::Detached {
+            co_await executor.schedule();
+            co_await std::move(task);
+        }(executor, std::move(task));
+        detached.handle.resume(); // runs up to schedule()
+    }
+
+    // Blocks the calling thread until the task, run on the executor, is done.
+    // Must not be called from the executor's threads
+    template<class T>
+    T syncWait(Executor& executor, Task<T> task)
+    {
+        std::promise<T> promise;
+        auto future = promise.get_future();
+
+        // The frame owns the promise: it may still be inside set_value() when get() returns
+        auto detached = [] (Executor& executor, Task<T> task, std::promise<T> promise) -> detail::Detached {
+            co_await executor.schedule();
+            try {
+                if constexpr (std::is_void_v<T>) {
+                    co_await std::move(task);
+                    promise.set_value();
+                }
+                else {
+                    promise.set_value(co_await std::move(task));
+                }
+            }
+            catch (...) {
+                promise.set_exception(std::current_exception());
+            }
+        }(executor, std::move(task), std::move(promise));
+        detached.handle.resume();
+
+        return future.get();
+    }
+
+
+    // Awaitables. Each one completes on the transport's thread and resumes the coroutine on the executor
+
+    class ConnectAwaiter {
+    public:
+        ConnectAwaiter(Executor& executor, AdbDevice::SharedPointer device, std::chrono::milliseconds timeout);
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle);
+        AdbDevice::ConnectionState await_resume() const noexcept { return mResult; }
+
+    private:
+        Executor& mExecutor;
+        AdbDevice::SharedPointer mDevice;
+        std::chrono::milliseconds mTimeout;
+        AdbDevice::ConnectionState mResult = AdbDevice::OFFLINE;
+    };
+
+    class OpenAwaiter {
+    public:
+        OpenAwaiter(Executor& executor, AdbDevice::SharedPointer device, std::string destination);
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle);
+        std::optional<AdbDevice::Streams> await_resume() { return std::move(mResult); }
+
+    private:
+        Executor& mExecutor;
+        AdbDevice::SharedPointer mDevice;
+        std::string mDestination;
+        std::optional<AdbDevice::Streams> mResult;
+    };
+
+    // Takes over the stream's data listener while suspended
+    class ReadAwaiter {
+    public:
+        ReadAwaiter(Executor& executor, AdbIStream& stream);
+
+        bool await_ready();
+        bool await_suspend(std::coroutine_handle<> handle);
+        std::optional<APayload> await_resume(); // nullopt once the stream is closed and drained
+
+    private:
+        // Decides whether await_suspend or the listener resumes the coroutine
+        struct Wake {
+            enum State { ARMING, ARMED, FIRED };
+
+            Executor& executor;
+            std::coroutine_handle<> handle;
+            std::atomic<State> state{ARMING};
+        };
+
+        Executor& mExecutor;
+        AdbIStream& mStream;
+        std::optional<APayload> mResult;
+    };
+
+    class WriteAwaiter {
+    public:
+        WriteAwaiter(Executor& executor, AdbOStream& stream, APayload&& payload);
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle);
+        Transport::ErrorCode await_resume() const noexcept { return mResult; }
+
+    private:
+        Executor& mExecutor;
+        AdbOStream& mStream;
+        std::optional<APayload> mPayload;
+        Transport::ErrorCode mResult = Transport::CANCELLED;
+    };
+
+    inline ConnectAwaiter connect(Executor& executor, AdbDevice::SharedPointer device,
+                                  std::chrono::milliseconds timeout = AdbDevice::DEFAULT_CONNECT_TIMEOUT)
+    {
+        return {executor, std::move(device), timeout};
+    }
+
+    inline OpenAwaiter open(Executor& executor, AdbDevice::SharedPointer device, std::string destination)
+    {
+        return {executor, std::move(device), std::move(destination)};
+    }
+
+    inline ReadAwaiter read(Executor& executor, AdbIStream& stream)
+    {
+        return {executor, stream};
+    }
+
+    // Resumes once the WRTE has left the transport
+    inline WriteAwaiter write(Executor& executor, AdbOStream& stream, APayload payload)
+    {
+        return {executor, stream, std::move(payload)};
+    }
+}
+
+
+#endif //ADB_LIB_ADBCORO_HPP
@@ -1,16 +1,23 @@
 #ifndef ADB_LIB_ADBDEVICE_HPP
 #define ADB_LIB_ADBDEVICE_HPP
 
-#include <map>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <optional>
+#include <unordered_map>
 #include <vector>
 #include <condition_variable>
 
 #include "AdbBase.hpp"
 #include "AdbStreams.hpp"
+#include "SlotTable.hpp"
+#include "TimerQueue.hpp"
 
 
 class AdbDevice
         : protected AdbBase
+        , private AdbPacketHandler<AdbDevice>
         , public std::enable_shared_from_this<AdbDevice>
 {
 public:
@@ -40,6 +47,22 @@ public:
         RESCUE
     };
 
+    // Called once per attempt with the final state: connected, UNAUTHORIZED or OFFLINE (timed out).
+    // Runs on the transport's event thread or on the timer thread, must not block
+    using ConnectCallback = std::function<void(ConnectionState)>;
+    using ConnectResultListener = std::function<void(const SharedPointer&, ConnectionState)>;
+
+    // Gets nullopt if the device refused the stream or went away. Runs on the transport's event thread
+    using OpenCallback = std::function<void(std::optional<Streams>)>;
+
+    // Takes a stream opened by the device, dropping the Streams closes it.
+    // Runs on the transport's event thread, must not block
+    using OpenHandler = std::function<void(const std::string& destination, Streams streams)>;
+
+    static constexpr std::chrono::milliseconds NO_TIMEOUT = std::chrono::milliseconds::max();
+    // A device that is asking the user to allow the key needs longer than this
+    static constexpr std::chrono::milliseconds DEFAULT_CONNECT_TIMEOUT = std::chrono::seconds(10);
+
 public:
     static SharedPointer make(UniqueTransport&& transport);
     ~AdbDevice() override;
@@ -48,6 +71,15 @@ public:
     void setPrivateKeyPaths(std::vector<std::string> paths);
     void addPrivateKeyPath(const std::string_view& path);
     void setPublicKeyPath(const std::string_view& path);
+    // Serial from a previous connection: the key it accepted is tried first
+    void setSerialHint(const std::string& serial);
+    // Certificate for devices that ask for STLS (wireless debugging), the key must be one the device has paired with.
+    // Without it such devices end up UNAUTHORIZED
+    void setTlsConfig(const Transport::TlsConfig& config);
+
+    // Backpressure of streams opened after the call, by either side. Each stream can change its own later
+    void setStreamWatermarks(AdbStreamBase::Watermarks watermarks);
+    [[nodiscard]] AdbStreamBase::Watermarks getStreamWatermarks() const;
 
     const std::string& getSerial() const;
     const std::string& getProduct() const;
@@ -57,9 +89,39 @@ public:
     const std::string& getSystemType() const;
     uint32_t getConnectionState() const;
     const FeatureSet& getFeatures() const;
-
-    void connect();
+    using AdbBase::getMaxData;
+
+    // Blocks until the attempt is finished, returns isConnected().
+    // Mustn't be called from the transport's event thread
+    bool connect(std::chrono::milliseconds timeout = DEFAULT_CONNECT_TIMEOUT);
+    // Joins the attempt in flight if there's one, reports right away if already connected
+    void connectAsync(std::chrono::milliseconds timeout, ConnectCallback callback);
+    std::future<ConnectionState> connectAsync(std::chrono::milliseconds timeout);
+
+    // Starts handshakes with all the devices at once and waits for every one of them.
+    // Results are in the same order as devices, listener is called as each one finishes
+    static std::vector<ConnectionState> connectAll(const std::vector<SharedPointer>& devices,
+                                                   std::chrono::milliseconds timeout,
+                                                   const ConnectResultListener& listener = {});
+
+    // Any number of opens can be in flight, each one waits only for its own reply.
+    // Blocking open() mustn't be called from the transport's event thread
     std::optional<Streams> open(const std::string_view& destination);
+    void openAsync(const std::string_view& destination, OpenCallback callback);
+    std::future<std::optional<Streams>> openAsync(const std::string_view& destination);
+    // The stream starts in reactor mode: handlers are set before the first payload can arrive
+    void openAsync(const std::string_view& destination, AdbStreamBase::Handlers handlers, OpenCallback callback);
+    // Sends all OPENs at once, results are in the same order as destinations
+    std::vector<std::optional<Streams>> openMany(const std::vector<std::string>& destinations);
+
+    // Device-initiated streams are routed by destination: exact match ("tcp:7000"),
+    // then service ("tcp:"), then the catch-all (""). Unrouted OPENs are refused
+    void setOpenHandler(const std::string& destination, OpenHandler handler);
+    void resetOpenHandler(const std::string& destination);
+
+    // adb reverse: connections to deviceSpec on the device are opened to hostSpec and passed to handler
+    bool reverse(const std::string& deviceSpec, const std::string& hostSpec, OpenHandler handler);
+    bool removeReverse(const std::string& deviceSpec, const std::string& hostSpec);
 
 
     [[nodiscard]] bool isConnected() const;
@@ -69,31 +131,39 @@ private:
     explicit AdbDevice(UniqueTransport&& transport);
 
 public: // Stream's actions
-    void closeStream(uint32_t localId);
-    void send(uint32_t localId, uint32_t remoteId, APayload&& payload);
+    void closeStream(uint32_t localId, uint32_t remoteId);
+    void send(uint32_t localId, uint32_t remoteId, APayload&& payload, SendCompletion completion = {});
+    void acknowledge(uint32_t localId, uint32_t remoteId); // lets the device send the next WRTE
+
+private: // Packet processing, dispatched by AdbPacketHandler
+    friend AdbPacketHandler<AdbDevice>;
 
-private: // Packet processing
     void processConnect(const APacket&);
     void processOpen(const APacket&);
     void processReady(const APacket&);
     void processClose(const APacket&);
-    void processWrite(const APacket&);
-    void processAuth(const APacket&);
+    void processWrite(APacket&);
+    void processAuth(APacket&);
     void processTls(const APacket&);
+    void processUnknown(const APacket&);
 
-    void packetListener(const APacket& packet);
     void errorListener(int errorCode, const APacket* packet, bool incomingPacket);
 
+    void answerAuth(const APayload& token, uint64_t attempt); // on KeyStore's workers
+    // Key state belongs to the attempt in flight, these run under mConnectMutex
     std::optional<APayload> signWithPrivateKey(const APayload& hash);
-    bool sendPublicKey();
+    std::optional<APayload> takePublicKey(); // once per attempt
+    void orderKeys();
 
 private:
     void setConnectionState(ConnectionState state);
     bool setSystemType(const std::string_view& systemType);
     void stopConnecting();
+    void finishConnecting();
+    void connectTimedOut(uint64_t attempt);
 
     FeatureSet mFeatureSet;
-    ConnectionState mConnectionState;
+    std::atomic<ConnectionState> mConnectionState;
     std::string mSystemType;
 
     // Details:
@@ -102,28 +172,46 @@ private:
     std::string mModel   = {};
     std::string mDevice  = {};
 
-    // Auxiliary:
-    std::condition_variable mConnected;
+    // Connection attempt:
+    std::mutex mConnectMutex;
+    bool mConnecting = false;
+    uint64_t mConnectAttempt = 0;
+    TimerQueue::Id mConnectTimer = TimerQueue::INVALID_ID;
+    std::vector<ConnectCallback> mConnectCallbacks;
 
     // Streams:
-    using StreamBase = std::weak_ptr<AdbStreamBase>;
-
-    struct AwaitingStream {
-        std::condition_variable cv = {};
-        uint32_t remoteId = 0;
-        bool rejected = false;
+    struct StreamSlot {
+        std::weak_ptr<AdbStreamBase> stream; // empty while the open is pending
+        OpenCallback pendingOpen;
+        std::optional<AdbStreamBase::Handlers> handlers = {}; // reactor mode for the pending open
     };
 
-    uint32_t mLastLocalId;
-    std::mutex mStreamsMutex;
-    std::map<uint32_t /*localId*/, StreamBase> mActiveStreams;
-    std::map<uint32_t /*localId*/, AwaitingStream> mAwaitingStreams;
+    void startOpen(const std::string_view& destination, StreamSlot&& slot);
+    void failOpen(uint32_t localId);
+    void failAllOpens();
+    void closeAllStreams(); // the transport is gone
+
+    // Local id is the slot's id: recycled, and looked up without locks on the receive path
+    SlotTable<StreamSlot> mStreams;
+
+    OpenHandler findOpenHandler(const std::string& destination);
+    bool requestReverse(const std::string& service);
+
+    std::mutex mOpenHandlersMutex;
+    std::unordered_map<std::string /*destination*/, OpenHandler> mOpenHandlers;
 
     // Keys:
     std::vector<std::string> mPrivateKeyPaths;
+    std::vector<std::string> mKeyOrder; // mPrivateKeyPaths, the accepted one first
     size_t mNextKey = 0;
+    std::string mLastSignedKey;
+    std::string mSerialHint;
     std::string mPublicKeyPath;
     bool mPublicIsAlreadyTried = false;
+    std::optional<Transport::TlsConfig> mTlsConfig;
+
+    mutable std::mutex mWatermarksMutex;
+    AdbStreamBase::Watermarks mWatermarks = AdbStreamBase::DEFAULT_WATERMARKS;
 };
 
 #endif //ADB_LIB_ADBDEVICE_HPP
@@ -0,0 +1,65 @@
+#ifndef ADB_LIB_ADBPACKETHANDLER_HPP
+#define ADB_LIB_ADBPACKETHANDLER_HPP
+
+#include "APacket.hpp"
+#include "Transport.hpp"
+
+
+// Compile-time packet handler (CRTP).
+// Derived hides the handlers it's interested in, calls are resolved statically and can be inlined:
+//
+//   class MyHandler : public AdbPacketHandler<MyHandler> {
+//       friend AdbPacketHandler<MyHandler>;
+//       void processWrite(const APacket&);
+//   };
+//
+// Install with AdbBase::setPacketHandler(). AdbBase::setPacketListener() stays as std::function adapter
+template <class Derived>
+class AdbPacketHandler {
+public:
+    // Perfect hash of the command codes onto 0..7, keeps the switch below dense (a jump table).
+    // A collision would be a duplicate case label, so it can't go unnoticed
+    static constexpr uint32_t commandSlot(uint32_t command)
+    {
+        return (command * 0x2bfu) >> 29;
+    }
+
+    // Handlers may take the packet by non-const reference to move its payload out
+    void dispatch(APacket& packet)
+    {
+        auto& self = static_cast<Derived&>(*this);
+        const auto command = packet.getMessage().command;
+
+        switch (commandSlot(command)) {
+            case commandSlot(A_CNXN): if (command == A_CNXN) return self.processConnect(packet); break;
+            case commandSlot(A_OPEN): if (command == A_OPEN) return self.processOpen(packet);    break;
+            case commandSlot(A_OKAY): if (command == A_OKAY) return self.processReady(packet);   break;
+            case commandSlot(A_CLSE): if (command == A_CLSE) return self.processClose(packet);   break;
+            case commandSlot(A_WRTE): if (command == A_WRTE) return self.processWrite(packet);   break;
+            case commandSlot(A_AUTH): if (command == A_AUTH) return self.processAuth(packet);    break;
+            case commandSlot(A_STLS): if (command == A_STLS) return self.processTls(packet);     break;
+            case commandSlot(A_SYNC): break; // obsolete
+            default: break;
+        }
+
+        self.processUnknown(packet);
+    }
+
+    void dispatchError(int errorCode, const APacket* packet, bool incomingPacket)
+    {
+        static_cast<Derived&>(*this).errorListener(errorCode, packet, incomingPacket);
+    }
+
+protected: // Default handlers, ignore the packet
+    void processConnect(const APacket&) {}
+    void processOpen(const APacket&) {}
+    void processReady(const APacket&) {}
+    void processClose(const APacket&) {}
+    void processWrite(const APacket&) {}
+    void processAuth(const APacket&) {}
+    void processTls(const APacket&) {}
+    void processUnknown(const APacket&) {}
+    void errorListener(int /*errorCode*/, const APacket*, bool /*incomingPacket*/) {}
+};
+
+#endif //ADB_LIB_ADBPACKETHANDLER_HPP
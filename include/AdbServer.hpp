@@ -0,0 +1,68 @@
+#ifndef ADB_LIB_ADBSERVER_HPP
+#define ADB_LIB_ADBSERVER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_set>
+
+#include "DeviceManager.hpp"
+#include "ForwardEngine.hpp"
+#include "SmartSocket.hpp"
+#include "ThreadPool.hpp"
+
+
+// Speaks adb server's host protocol, so stock adb clients can use devices managed by the library.
+// Supported: host:version, host:devices, host:devices-l, host:kill, host:features,
+// host:transport:<serial>, host:transport-any, host-serial:<serial>:<query>
+// and passthrough of any other service to the selected device.
+// Requests are answered on a small pool of handshake threads, an opened service is handed
+// to a ForwardEngine, whose single epoll thread moves the data of every client. Linux only
+class AdbServer {
+public:
+    using UniquePointer = std::unique_ptr<AdbServer>;
+
+    static constexpr int VERSION = 41; // adb server protocol version we claim to speak
+    static constexpr size_t HANDSHAKE_THREADS = 4;
+    static constexpr std::chrono::seconds HANDSHAKE_TIMEOUT{10}; // a silent client doesn't hold a thread longer
+
+public:
+    static UniquePointer make(DeviceManager& manager, const SmartSocket::Endpoint& endpoint);
+    AdbServer(const AdbServer&) = delete;
+    ~AdbServer();
+
+    void stop();
+    void wait(); // until stop() or host:kill
+
+    [[nodiscard]] bool isRunning() const;
+
+private:
+    AdbServer(DeviceManager& manager, int listenFd, ForwardEngine::UniquePointer engine);
+
+    void acceptClients();
+    bool serveClient(int fd); // true if the connection is no longer the handshake's: opening or with the engine
+    bool serveHostRequest(int fd, const std::string& request, AdbDevice::SharedPointer& selected);
+    bool serveService(int fd, const AdbDevice::SharedPointer& device, const std::string& service);
+    void finishService(int fd, const AdbDevice::SharedPointer& device, std::optional<AdbDevice::Streams> streams);
+
+    AdbDevice::SharedPointer selectDevice(const std::string& serial) const; // empty serial - any device
+    std::string formatDevices(bool longFormat) const;
+
+    DeviceManager& mManager;
+    int mListenFd;
+    std::atomic<bool> mRunning;
+    std::thread mAcceptThread;
+    ThreadPool mHandshakes;
+    ForwardEngine::UniquePointer mEngine;
+
+    mutable std::mutex mClientsMutex;
+    std::condition_variable mClientsChanged;
+    std::unordered_set<int> mClients; // in handshake, shut down by stop()
+    size_t mPendingOpens = 0;         // services waiting for the device, the destructor waits for them
+};
+
+
+#endif //ADB_LIB_ADBSERVER_HPP
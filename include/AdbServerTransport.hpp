@@ -0,0 +1,113 @@
+#ifndef ADB_LIB_ADBSERVERTRANSPORT_HPP
+#define ADB_LIB_ADBSERVERTRANSPORT_HPP
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "SmartSocket.hpp"
+#include "ThreadPool.hpp"
+#include "Transport.hpp"
+
+
+// Transport that reaches a device through a running adb server (host smart-socket protocol).
+// The server keeps owning the USB interface, the transport emulates the device side of ADB:
+// every OPEN becomes a server connection switched to the device with host:transport:<serial>.
+// Such connections are prepared in advance and pooled, so an OPEN costs one service request.
+class AdbServerTransport
+        : public Transport
+{
+public:
+    struct Config {
+        SmartSocket::Endpoint endpoint;
+        size_t poolSize;        // connections kept switched to the device
+        size_t workerCount;     // threads performing OPEN handshakes
+    };
+
+public:
+    AdbServerTransport(const AdbServerTransport&) = delete;
+    ~AdbServerTransport() override;
+
+    static std::unique_ptr<AdbServerTransport> make(const std::string& serial);
+    static std::unique_ptr<AdbServerTransport> make(const std::string& serial, const Config& config);
+
+    static std::vector<SmartSocket::DeviceInfo> listDevices(const SmartSocket::Endpoint& endpoint);
+
+    [[nodiscard]] const std::string& getSerial() const;
+
+public: // Transport Interface
+    using Transport::send;
+    void send(APacket&& packet, Completion completion) override;
+    void receive() override;
+
+private:
+    struct Outgoing {
+        APacket packet;
+        Completion completion;
+        size_t written;                 // payload bytes already taken by the socket
+    };
+
+    struct Connection {
+        Connection(int fd, uint32_t localId);
+        ~Connection(); // closes fd
+
+        int fd;                         // non-blocking
+        uint32_t localId;               // host's id of the stream
+        std::atomic<bool> hostReady;    // host sent OKAY for our last WRTE, socket may be read again
+
+        std::mutex outgoingMutex;
+        std::deque<Outgoing> outgoing;  // WRTE payloads, written by the I/O thread as the socket takes them
+        bool closed = false;
+    };
+    using SharedConnection = std::shared_ptr<Connection>;
+
+    AdbServerTransport(std::string serial, const Config& config);
+
+    // handshakes, run on workers
+    void connectToDevice();
+    void openStream(uint32_t localId, std::string destination);
+    int takePooledConnection();
+    void refillPool();
+
+    // outgoing packets
+    void write(APacket&& packet, Completion completion);
+    void hostReady(uint32_t remoteId);
+    void closeStream(uint32_t remoteId, bool notifyHost); // pending writes are CANCELLED
+    void complete(APacket& packet, const Completion& completion, ErrorCode errorCode);
+
+    // incoming packets, delivered on the I/O thread
+    void enqueue(APacket&& packet);
+    void wake();
+    void run();
+    void readFrom(uint32_t remoteId, const SharedConnection& connection);
+    void flush(uint32_t remoteId, const SharedConnection& connection);
+    void deliver();
+    void disconnect(); // the device is gone, TRANSPORT_DISCONNECTED goes to the receive listener
+
+    std::string mSerial;
+    Config mConfig;
+
+    std::mutex mPoolMutex;
+    std::vector<int> mPool;
+    bool mRefilling = false;
+
+    std::mutex mConnectionsMutex;
+    std::unordered_map<uint32_t /*remoteId*/, SharedConnection> mConnections;
+    uint32_t mLastRemoteId = 0;
+
+    std::mutex mIncomingMutex;
+    std::deque<APacket> mIncoming;
+    bool mReceiveRequested = false;
+    bool mDisconnected = false;
+    bool mDisconnectReported = false;
+
+    int mWakePipe[2] = {-1, -1};
+    std::atomic<bool> mRunning;
+    std::thread mThread;
+    ThreadPool mWorkers;
+};
+
+
+#endif //ADB_LIB_ADBSERVERTRANSPORT_HPP
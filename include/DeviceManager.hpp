@@ -0,0 +1,121 @@
+#ifndef ADB_LIB_DEVICEMANAGER_HPP
+#define ADB_LIB_DEVICEMANAGER_HPP
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <ObjLibusb.hpp>
+
+#include "AdbDevice.hpp"
+#include "ThreadPool.hpp"
+#include "UsbEventLoopPool.hpp"
+#include "UsbTransport.hpp"
+
+
+class DeviceManager {
+public:
+    using UniquePointer = std::unique_ptr<DeviceManager>;
+    using SharedContext = std::shared_ptr<ObjLibusbContext>;
+    using DeviceListener = std::function<void(const AdbDevice::SharedPointer&)>;
+
+    struct Config {
+        size_t workerCount = 4;              // threads bringing devices up in parallel
+        bool autoConnect = true;             // connect AdbDevice as soon as the transport is up, and retry
+                                             // until the device is authorized or goes away
+                                             // (otherwise devices are found by their USB serial number)
+        std::chrono::milliseconds connectTimeout = AdbDevice::DEFAULT_CONNECT_TIMEOUT;
+        std::vector<std::string> privateKeyPaths;
+        std::string publicKeyPath;
+    };
+
+public:
+    static UniquePointer make(SharedContext context);
+    static UniquePointer make(SharedContext context, Config config);
+
+    // Devices are spread across the pool's loops, the pool is kept alive by the manager
+    static UniquePointer make(UsbEventLoopPool::SharedPointer loops, Config config);
+    DeviceManager(const DeviceManager&) = delete;
+    ~DeviceManager();
+
+    // Starts watching USB devices, already attached devices are enumerated too.
+    // Unless the manager was made with a loop pool, event handling for the context has to run somewhere
+    // (e.g. ObjLibusbContext::spawnEventHandlingThread)
+    // Returns false if hotplug isn't available, devices attached at the moment are brought up anyway
+    bool start();
+    void stop();
+
+    [[nodiscard]] AdbDevice::SharedPointer find(const std::string& serial) const;
+    [[nodiscard]] std::vector<AdbDevice::SharedPointer> getDevices() const;
+    [[nodiscard]] size_t getDeviceCount() const;
+
+    AdbDevice::SharedPointer waitForDevice(const std::string& serial, std::chrono::milliseconds timeout);
+    AdbDevice::SharedPointer waitForAny(std::chrono::milliseconds timeout);
+
+    // Listeners are called from the manager's worker threads
+    void setAttachListener(DeviceListener listener);
+    void setDetachListener(DeviceListener listener);
+
+public: // Callback | CALLED FROM LIBUSB's EVENT HANDLING THREAD
+    static int staticHotplugCallback(libusb_context*, libusb_device*, libusb_hotplug_event, void* userData);
+
+private:
+    struct Shard {
+        DeviceManager* manager;
+        SharedContext context;
+        size_t index;
+        bool hotplugRegistered;
+        libusb_hotplug_callback_handle hotplugHandle;
+    };
+
+    DeviceManager(std::vector<SharedContext> contexts, Config config);
+
+    // Physical location of the device, stays the same across re-enumeration
+    using LocationKey = std::string;
+    static LocationKey makeLocationKey(libusb_device* device);
+    static std::string readSerialNumber(libusb_device* device); // iSerialNumber, empty if there's none
+
+    struct Arrival {
+        UsbTransport::Device device;
+        std::string serialNumber; // read unless autoConnect, CNXN tells it otherwise
+    };
+
+    static constexpr auto CONNECT_RETRY_DELAY = std::chrono::seconds(1);
+
+    void arrived(const LocationKey& key, libusb_device* device);
+    void attach(const LocationKey& key, const Arrival& arrival);
+    void connect(const LocationKey& key, const AdbDevice::SharedPointer& device);
+    void retryConnect(const LocationKey& key, const AdbDevice::SharedPointer& device);
+    void publish(const LocationKey& key, const AdbDevice::SharedPointer& device, const std::string& serialNumber);
+    void abandon(const LocationKey& key); // stopping, the pending device is dropped
+    void detach(const LocationKey& key);
+    std::optional<InterfaceData> lookupInterface(const LocationKey& key, const UsbTransport::Device& device);
+
+    UsbEventLoopPool::SharedPointer mLoops;
+    std::vector<std::unique_ptr<Shard>> mShards; // Shard's address is hotplug callback's user data
+    Config mConfig;
+    ThreadPool mWorkers;
+
+    // Enumeration cache, nullopt marks non-ADB devices
+    std::mutex mCacheMutex;
+    std::unordered_map<LocationKey, std::optional<InterfaceData>> mInterfaceCache;
+
+    mutable std::mutex mDevicesMutex;
+    std::condition_variable mDeviceAdded;
+    std::unordered_map<std::string /*serial*/, AdbDevice::SharedPointer> mDevices;
+    std::unordered_map<LocationKey, std::string /*serial*/> mSerials;
+    std::unordered_set<LocationKey> mPending;
+    // Pending keys that went away, with the device that came back to the same location meanwhile
+    std::unordered_map<LocationKey, std::optional<Arrival>> mDetached;
+    std::unordered_map<LocationKey, std::string /*serial*/> mLastSerials; // survives detach, for key affinity
+
+    DeviceListener mAttachListener;
+    DeviceListener mDetachListener;
+};
+
+
+#endif //ADB_LIB_DEVICEMANAGER_HPP
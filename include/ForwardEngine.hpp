@@ -0,0 +1,157 @@
+#ifndef ADB_LIB_FORWARDENGINE_HPP
+#define ADB_LIB_FORWARDENGINE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "AdbDevice.hpp"
+#include "PayloadPool.hpp"
+
+
+// adb forward: local TCP ports to services on devices ("tcp:8080", "localabstract:chrome_devtools_remote").
+// Every accepted connection gets its own stream, one epoll thread moves data for all of them.
+// A connection has at most one payload in flight each way, so a slow side holds the other back. Linux only
+class ForwardEngine {
+public:
+    using UniquePointer = std::unique_ptr<ForwardEngine>;
+    using ForwardId = uint32_t;
+
+    struct Counters {
+        uint64_t acceptedConnections;
+        uint64_t activeConnections;
+        uint64_t failedOpens;
+        uint64_t bytesToDevice;
+        uint64_t bytesFromDevice;
+    };
+
+public:
+    static UniquePointer make(); // nullptr if epoll isn't available
+    ForwardEngine(const ForwardEngine&) = delete;
+    ~ForwardEngine();
+
+    // localPort 0 picks a free port, see getLocalPort()
+    std::optional<ForwardId> forward(const AdbDevice::SharedPointer& device,
+                                     uint16_t localPort,
+                                     const std::string& destination);
+    bool removeForward(ForwardId id);
+
+    // Pumps an open stream through a socketpair and returns the caller's end (blocking, close-on-exec), -1 on failure.
+    // Device bytes land in userspace buffers and are copied into the socket once; downstream,
+    // splice() through a pipe moves them to files or sockets without copies through userspace.
+    // Closing the fd closes the stream and vice versa
+    int attach(const AdbDevice::SharedPointer& device, AdbDevice::Streams streams);
+
+    // Pumps an open stream through a connected socket, the engine takes the fd over and makes it non-blocking.
+    // false if the engine is stopped, the fd is closed then
+    bool adopt(const AdbDevice::SharedPointer& device, AdbDevice::Streams streams, int fd);
+    void stop(); // closes all forwards and connections
+
+    [[nodiscard]] std::optional<uint16_t> getLocalPort(ForwardId id) const;
+    [[nodiscard]] std::optional<Counters> getCounters(ForwardId id) const;
+    [[nodiscard]] std::vector<ForwardId> getForwards() const;
+
+private:
+    struct Forward {
+        ForwardId id;
+        int listenFd;
+        uint16_t port;
+        std::weak_ptr<AdbDevice> device;
+        std::string destination;
+        PayloadPool pool; // socket -> device buffers, sized to device's max data
+
+        std::atomic<uint64_t> acceptedConnections{0};
+        std::atomic<uint64_t> activeConnections{0};
+        std::atomic<uint64_t> failedOpens{0};
+        std::atomic<uint64_t> bytesToDevice{0};
+        std::atomic<uint64_t> bytesFromDevice{0};
+
+        Forward(ForwardId id, int listenFd, uint16_t port, const AdbDevice::SharedPointer& device, std::string destination);
+    };
+    using SharedForward = std::shared_ptr<Forward>;
+
+    struct Connection {
+        Connection(int fd, SharedForward forward);
+
+        int fd;
+        SharedForward forward;
+        std::optional<AdbDevice::Streams> streams; // empty while the open is pending
+        std::optional<APayload> toSocket;           // device -> socket payload being written
+        size_t toSocketOffset = 0;
+        bool writingToDevice = false;               // socket -> device payload in flight
+        uint32_t events = 0;                        // registered with epoll
+        bool registered = false;
+        bool closing = false;
+    };
+
+    // Events from the transport's threads, they reach the engine through a weakly held Mailbox
+    struct Event {
+        enum Type {
+            OPENED,
+            READABLE,
+            WRITTEN,
+            REMOVE_FORWARD,
+            ATTACH,
+        };
+
+        Type type;
+        uint64_t connectionId;
+        std::optional<AdbDevice::Streams> streams = std::nullopt;
+        Transport::ErrorCode errorCode = Transport::OK;
+        SharedForward forward = nullptr;
+        int fd = -1; // ATTACH
+    };
+
+    struct Mailbox {
+        explicit Mailbox(int wakeFd);
+        ~Mailbox();
+        bool post(Event&& event); // false once closed, the event stays with the caller
+        std::vector<Event> take();
+        void close();             // what was posted before can still be taken
+
+        const int wakeFd;
+        std::mutex mutex;
+        std::vector<Event> events;
+        bool closed = false;
+    };
+    using WeakMailbox = std::weak_ptr<Mailbox>;
+
+    ForwardEngine(int epollFd, std::shared_ptr<Mailbox> mailbox);
+
+    void run();
+    void processEvents();
+    void acceptConnections(ForwardId forwardId);
+    void onAttach(Event&& event);
+    void onOpened(uint64_t connectionId, std::optional<AdbDevice::Streams>&& streams);
+    void onWritten(uint64_t connectionId, Transport::ErrorCode errorCode);
+    void onSocketEvents(uint64_t connectionId, uint32_t events);
+    void removeForwardNow(const SharedForward& forward);
+
+    void pumpToDevice(uint64_t connectionId, Connection& connection);
+    void pumpFromDevice(Connection& connection);
+    bool flushToSocket(Connection& connection);
+    void updateEvents(uint64_t connectionId, Connection& connection);
+    void closeConnection(uint64_t connectionId);
+
+    const int mEpollFd;
+    std::shared_ptr<Mailbox> mMailbox;
+    std::atomic<bool> mRunning;
+    std::thread mThread;
+
+    mutable std::mutex mForwardsMutex;
+    std::unordered_map<ForwardId, SharedForward> mForwards;
+    ForwardId mLastForwardId = 0;
+
+    // Engine thread only:
+    std::unordered_map<uint64_t, Connection> mConnections;
+    uint64_t mLastConnectionId = 0;
+};
+
+
+#endif //ADB_LIB_FORWARDENGINE_HPP
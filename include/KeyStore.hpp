@@ -0,0 +1,75 @@
+#ifndef ADB_LIB_KEYSTORE_HPP
+#define ADB_LIB_KEYSTORE_HPP
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include <mbedtls/pk.h>
+
+#include "APayload.hpp"
+#include "ThreadPool.hpp"
+
+
+// Process-wide cache of parsed private keys and public key files, shared by all AdbDevices.
+// Files are re-read only if they were modified. Also remembers which key each device accepted
+// and runs signing off the USB event threads
+class KeyStore {
+public:
+    class PrivateKey {
+    public:
+        PrivateKey(const PrivateKey&) = delete;
+        ~PrivateKey();
+
+        // signs SHA1 hash, thread-safe
+        bool sign(const uint8_t* hash, size_t hashLen, uint8_t* signature, size_t signatureLen);
+
+    private:
+        explicit PrivateKey(mbedtls_pk_context* context);
+        friend KeyStore;
+
+        std::mutex mMutex; // RSA blinding state is updated on every signature
+        mbedtls_pk_context* mContext;
+    };
+    using SharedPrivateKey = std::shared_ptr<PrivateKey>;
+
+    static constexpr size_t SIGNING_THREADS = 2;
+
+public:
+    static KeyStore& shared();
+    KeyStore(const KeyStore&) = delete;
+
+    SharedPrivateKey getPrivateKey(const std::string& path); // nullptr if the file isn't a valid key
+    std::optional<APayload> getPublicKey(const std::string& path);
+
+    // Key affinity: the key a device accepted is tried first next time
+    void setAcceptedKey(const std::string& serial, const std::string& path);
+    std::optional<std::string> getAcceptedKey(const std::string& serial) const;
+
+    bool post(ThreadPool::Task task); // runs on the signing workers
+    void clear();                     // forgets cached keys, not the affinity
+
+private:
+    KeyStore();
+
+    template<class Value>
+    struct Cached {
+        std::filesystem::file_time_type modified;
+        Value value;
+    };
+
+    static std::optional<std::filesystem::file_time_type> modificationTime(const std::string& path);
+
+    mutable std::mutex mMutex;
+    std::unordered_map<std::string /*path*/, Cached<SharedPrivateKey>> mPrivateKeys;
+    std::unordered_map<std::string /*path*/, Cached<std::optional<APayload>>> mPublicKeys;
+    std::unordered_map<std::string /*serial*/, std::string /*path*/> mAcceptedKeys;
+
+    ThreadPool mWorkers;
+};
+
+
+#endif //ADB_LIB_KEYSTORE_HPP
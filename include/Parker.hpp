@@ -0,0 +1,97 @@
+#ifndef ADB_LIB_PARKER_HPP
+#define ADB_LIB_PARKER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#ifndef __linux__
+#include <condition_variable>
+#include <mutex>
+#endif
+
+
+// Waiting for a condition set by another thread without a mutex on the notifying side.
+// Waiters spin for a while, then sleep on a futex (a condition variable where there's no futex).
+// The spin adapts: it grows while spinning pays off and shrinks while waiters end up sleeping anyway.
+// notifyAll() is an atomic increment plus a load unless someone sleeps, one syscall wakes them all
+class Parker {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Parker() = default;
+    Parker(const Parker&) = delete;
+
+    // Returns once ready() is true, false if it's still false at the deadline.
+    // The notifier makes ready() true first, then calls notifyAll()
+    template<class Ready>
+    bool wait(Ready&& ready, Clock::time_point deadline = Clock::time_point::max());
+
+    void notifyAll();
+
+private:
+    static constexpr uint32_t MIN_SPIN = 16;
+    static constexpr uint32_t MAX_SPIN = 1024; // tens of microseconds of pause instructions at most
+
+    static void relax(); // pause/yield instruction
+    static bool canSpin(); // false on a single CPU, the notifier can't run while the waiter spins
+    bool park(uint32_t epoch, Clock::time_point deadline); // false on timeout
+    void wake();
+
+    std::atomic<uint32_t> mEpoch{0};   // futex word, bumped by every notification
+    std::atomic<uint32_t> mSleepers{0};
+    std::atomic<bool> mWakePending{false}; // a wake is on its way, notifiers skip the syscall
+    std::atomic<uint32_t> mSpinLimit{MIN_SPIN * 4};
+
+#ifndef __linux__
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+#endif
+};
+
+template<class Ready>
+bool Parker::wait(Ready&& ready, Clock::time_point deadline)
+{
+    if (ready())
+        return true;
+
+    auto limit = canSpin() ? mSpinLimit.load(std::memory_order_relaxed) : 0;
+    if (limit == 0) {
+        // A single CPU: let the notifier run instead of spinning
+        std::this_thread::yield();
+        if (ready())
+            return true;
+    }
+    for (uint32_t i = 0; i < limit; ++i) {
+        relax();
+        if (ready()) {
+            mSpinLimit.store(std::min(limit * 2, MAX_SPIN), std::memory_order_relaxed);
+            return true;
+        }
+    }
+    if (limit != 0)
+        mSpinLimit.store(std::max(limit / 2, MIN_SPIN), std::memory_order_relaxed);
+
+    while (true) {
+        // Registered before the last check: a notifier either sees the sleeper or the check sees its data
+        mSleepers.fetch_add(1);
+        mWakePending.store(false);
+        auto epoch = mEpoch.load();
+        if (ready()) {
+            mSleepers.fetch_sub(1);
+            return true;
+        }
+
+        bool woken = park(epoch, deadline);
+        mSleepers.fetch_sub(1);
+        if (ready())
+            return true;
+        if (!woken)
+            return false;
+    }
+}
+
+
+#endif //ADB_LIB_PARKER_HPP
@@ -0,0 +1,30 @@
+#ifndef ADB_LIB_PAYLOADPOOL_HPP
+#define ADB_LIB_PAYLOADPOOL_HPP
+
+#include <mutex>
+#include <vector>
+
+#include "APayload.hpp"
+
+
+// Free list of payload buffers of one size, saves an allocation per packet on hot paths
+class PayloadPool {
+public:
+    explicit PayloadPool(size_t bufferSize, size_t maxCached = 256);
+    PayloadPool(const PayloadPool&) = delete;
+
+    APayload acquire();              // empty payload with a buffer of at least getBufferSize() bytes
+    void release(APayload&& payload); // payloads with smaller buffers are dropped
+
+    [[nodiscard]] size_t getBufferSize() const;
+
+private:
+    const size_t mBufferSize;
+    const size_t mMaxCached;
+
+    std::mutex mMutex;
+    std::vector<APayload> mFree;
+};
+
+
+#endif //ADB_LIB_PAYLOADPOOL_HPP
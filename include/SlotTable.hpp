@@ -0,0 +1,243 @@
+#ifndef ADB_LIB_SLOTTABLE_HPP
+#define ADB_LIB_SLOTTABLE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+
+// Dense table of values addressed by generation-tagged ids.
+// Id = generation (high 16 bits, never 0) | slot index (low 16 bits), so an id is never 0
+// and the id of a removed value doesn't match the value that takes its slot later.
+//
+// read() is wait-free and may run concurrently with anything.
+// Writers (insert, exchange, erase, eraseIf) are serialized by a mutex, they never wait for readers:
+// unlinked nodes are deleted by a later writer that sees no readers in flight.
+template<class T>
+class SlotTable {
+public:
+    using Id = uint32_t;
+    static constexpr Id INVALID_ID = 0;
+
+    static constexpr unsigned INDEX_BITS = 16;
+    static constexpr unsigned SEGMENT_BITS = 8;
+    static constexpr size_t SEGMENT_SIZE = size_t{1} << SEGMENT_BITS;
+    static constexpr size_t SEGMENT_COUNT = size_t{1} << (INDEX_BITS - SEGMENT_BITS);
+    static constexpr size_t CAPACITY = SEGMENT_SIZE * SEGMENT_COUNT;
+
+public:
+    SlotTable() = default;
+    SlotTable(const SlotTable&) = delete;
+
+    ~SlotTable()
+    {
+        for (auto& segmentPointer : mSegments) {
+            auto* segment = segmentPointer.load(std::memory_order_relaxed);
+            if (!segment)
+                continue;
+            for (auto& slot : segment->slots)
+                delete slot.node.load(std::memory_order_relaxed);
+            delete segment;
+        }
+        for (auto* node : mRetired)
+            delete node;
+    }
+
+    // Returns INVALID_ID if the table is full, value is left untouched then
+    Id insert(T&& value)
+    {
+        std::scoped_lock lock(mWriteMutex);
+        uint32_t index;
+        if (!mFree.empty()) {
+            index = mFree.back();
+            mFree.pop_back();
+        }
+        else if (mNextIndex < CAPACITY) {
+            index = mNextIndex++;
+            auto& segmentPointer = mSegments[index >> SEGMENT_BITS];
+            if (!segmentPointer.load(std::memory_order_relaxed))
+                segmentPointer.store(new Segment, std::memory_order_release);
+        }
+        else {
+            return INVALID_ID;
+        }
+
+        auto& slot = slotAt(index);
+        if (++slot.generation == 0) // 0 is reserved, ids are never 0
+            slot.generation = 1;
+
+        Id id = (Id{slot.generation} << INDEX_BITS) | index;
+        slot.node.store(new Node{id, std::move(value)}, std::memory_order_seq_cst);
+        ++mSize;
+        return id;
+    }
+
+    // Wait-free. Calls f(const T&) if id is present, the value stays valid during the call only
+    template<class F>
+    bool read(Id id, F&& f) const
+    {
+        ReadGuard guard(mReaders);
+        const auto* node = find(id);
+        if (!node)
+            return false;
+
+        f(node->value);
+        return true;
+    }
+
+    // Replaces the value under id, returns the old one
+    std::optional<T> exchange(Id id, T value)
+    {
+        std::scoped_lock lock(mWriteMutex);
+        auto* slot = slotOf(id);
+        if (!slot)
+            return std::nullopt;
+
+        auto* node = slot->node.exchange(new Node{id, std::move(value)}, std::memory_order_seq_cst);
+        std::optional<T> old{node->value}; // readers may still look at the node, copy
+        retire(node);
+        return old;
+    }
+
+    std::optional<T> erase(Id id)
+    {
+        std::scoped_lock lock(mWriteMutex);
+        auto* slot = slotOf(id);
+        if (!slot)
+            return std::nullopt;
+
+        auto* node = slot->node.exchange(nullptr, std::memory_order_seq_cst);
+        std::optional<T> old{node->value};
+        release(id & INDEX_MASK, node);
+        return old;
+    }
+
+    // Erases id only if predicate(const T&) holds
+    template<class Predicate>
+    std::optional<T> erase(Id id, Predicate&& predicate)
+    {
+        std::scoped_lock lock(mWriteMutex);
+        auto* slot = slotOf(id);
+        if (!slot || !predicate(slot->node.load(std::memory_order_relaxed)->value))
+            return std::nullopt;
+
+        auto* node = slot->node.exchange(nullptr, std::memory_order_seq_cst);
+        std::optional<T> old{node->value};
+        release(id & INDEX_MASK, node);
+        return old;
+    }
+
+    // Removes all values matching predicate(const T&), returns them
+    template<class Predicate>
+    std::vector<T> eraseIf(Predicate&& predicate)
+    {
+        std::scoped_lock lock(mWriteMutex);
+        std::vector<T> result;
+        for (uint32_t index = 0; index < mNextIndex; ++index) {
+            auto& slot = slotAt(index);
+            auto* node = slot.node.load(std::memory_order_relaxed);
+            if (!node || !predicate(node->value))
+                continue;
+
+            slot.node.store(nullptr, std::memory_order_seq_cst);
+            result.push_back(node->value);
+            release(index, node);
+        }
+        return result;
+    }
+
+    size_t size() const
+    {
+        std::scoped_lock lock(mWriteMutex);
+        return mSize;
+    }
+
+private:
+    static constexpr Id INDEX_MASK = (Id{1} << INDEX_BITS) - 1;
+
+    struct Node {
+        Id id;
+        T value;
+    };
+
+    struct Slot {
+        std::atomic<Node*> node{nullptr};
+        uint16_t generation = 0; // writers only
+    };
+
+    struct Segment {
+        Slot slots[SEGMENT_SIZE];
+    };
+
+    struct ReadGuard {
+        explicit ReadGuard(std::atomic<size_t>& readers) : readers(readers) { readers.fetch_add(1, std::memory_order_seq_cst); }
+        ~ReadGuard() { readers.fetch_sub(1, std::memory_order_seq_cst); }
+        std::atomic<size_t>& readers;
+    };
+
+    const Node* find(Id id) const
+    {
+        auto index = id & INDEX_MASK;
+        const auto* segment = mSegments[index >> SEGMENT_BITS].load(std::memory_order_acquire);
+        if (!segment)
+            return nullptr;
+
+        const auto* node = segment->slots[index & (SEGMENT_SIZE - 1)].node.load(std::memory_order_seq_cst);
+        if (!node || node->id != id)
+            return nullptr;
+        return node;
+    }
+
+    Slot& slotAt(uint32_t index)
+    {
+        return mSegments[index >> SEGMENT_BITS].load(std::memory_order_relaxed)->slots[index & (SEGMENT_SIZE - 1)];
+    }
+
+    // Writers only, nullptr if id isn't present
+    Slot* slotOf(Id id)
+    {
+        auto index = id & INDEX_MASK;
+        if (index >= mNextIndex)
+            return nullptr;
+
+        auto& slot = slotAt(index);
+        auto* node = slot.node.load(std::memory_order_relaxed);
+        if (!node || node->id != id)
+            return nullptr;
+        return &slot;
+    }
+
+    void release(uint32_t index, Node* node)
+    {
+        mFree.push_back(index);
+        --mSize;
+        retire(node);
+    }
+
+    void retire(Node* node)
+    {
+        mRetired.push_back(node);
+
+        // Node is unlinked already: with no readers in flight nobody can be holding it
+        if (mReaders.load(std::memory_order_seq_cst) != 0)
+            return;
+
+        for (auto* retired : mRetired)
+            delete retired;
+        mRetired.clear();
+    }
+
+    std::atomic<Segment*> mSegments[SEGMENT_COUNT] = {};
+    mutable std::atomic<size_t> mReaders{0};
+
+    mutable std::mutex mWriteMutex;
+    uint32_t mNextIndex = 0;
+    size_t mSize = 0;
+    std::vector<uint32_t> mFree;
+    std::vector<Node*> mRetired;
+};
+
+
+#endif //ADB_LIB_SLOTTABLE_HPP
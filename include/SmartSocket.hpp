@@ -0,0 +1,68 @@
+#ifndef ADB_LIB_SMARTSOCKET_HPP
+#define ADB_LIB_SMARTSOCKET_HPP
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// adb server's host protocol: requests are "%04x<request>", replies are "OKAY" or "FAIL%04x<message>"
+namespace SmartSocket {
+
+    constexpr uint16_t DEFAULT_PORT = 5037;
+
+    struct Endpoint {
+        std::string host;           // used if unixSocketPath is empty
+        uint16_t port;
+        std::string unixSocketPath;
+
+        static Endpoint local(uint16_t port = DEFAULT_PORT);
+        static Endpoint unixSocket(const std::string& path);
+    };
+
+    // One line of host:devices-l
+    struct DeviceInfo {
+        std::string serial;
+        std::string state;
+        std::map<std::string, std::string> properties; // product, model, device, transport_id...
+    };
+
+    // Descriptor setup that also works where SOCK_CLOEXEC, MSG_NOSIGNAL and pipe2() are missing
+    int openSocket(int domain);     // stream socket, close-on-exec, -1 on failure
+    bool openPipe(int fds[2]);      // both ends non-blocking and close-on-exec
+    bool setNonBlocking(int fd);
+    void disableSigPipe(int fd);    // SO_NOSIGPIPE where send() has no MSG_NOSIGNAL, openSocket() does it already
+    extern const int NO_SIGNAL;     // send() flag, MSG_NOSIGNAL or 0
+
+    // All functions return -1 / false / nullopt on I/O errors. File descriptors are blocking
+    int connect(const Endpoint& endpoint);
+    int listen(const Endpoint& endpoint, int backlog = 128);
+    void close(int fd);
+
+    bool writeFully(int fd, const void* data, size_t size);
+    bool readFully(int fd, void* data, size_t size);
+
+    // Client side
+    bool sendRequest(int fd, std::string_view request);
+    bool readStatus(int fd, std::string* failMessage = nullptr);  // true on OKAY
+    std::optional<std::string> readLengthPrefixed(int fd);
+
+    // Connects, sends the request and waits for OKAY. Returns the connected fd or -1
+    int request(const Endpoint& endpoint, std::string_view request, std::string* failMessage = nullptr);
+    // Same for requests that reply with a length-prefixed string and close
+    std::optional<std::string> query(const Endpoint& endpoint, std::string_view request);
+
+    // Server side
+    std::optional<std::string> readRequest(int fd);
+    bool writeOkay(int fd);
+    bool writeOkay(int fd, std::string_view reply); // OKAY + length-prefixed reply
+    bool writeFail(int fd, std::string_view message);
+
+    std::vector<DeviceInfo> parseDevices(std::string_view devicesLong);
+    std::string formatLength(size_t length);
+}
+
+#endif //ADB_LIB_SMARTSOCKET_HPP
@@ -0,0 +1,93 @@
+#ifndef ADB_LIB_SPSCRING_HPP
+#define ADB_LIB_SPSCRING_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
+
+
+// Bounded lock-free queue for one producer thread and one consumer thread at a time.
+// Capacity is rounded up to a power of two. Each side keeps a cached copy of the other's index,
+// so the shared cache lines are touched only when the cached view says full (or empty)
+template<class T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity)
+        : mMask(roundUp(capacity) - 1)
+        , mSlots(std::make_unique<std::optional<T>[]>(mMask + 1))
+    {}
+
+    SpscRing(const SpscRing&) = delete;
+
+    // Producer. Value is left untouched if the ring is full
+    bool tryPush(T&& value)
+    {
+        auto tail = mTail.load(std::memory_order_relaxed);
+        if (tail - mCachedHead > mMask) {
+            mCachedHead = mHead.load(std::memory_order_acquire);
+            if (tail - mCachedHead > mMask)
+                return false;
+        }
+
+        mSlots[tail & mMask].emplace(std::move(value));
+        mTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer
+    std::optional<T> tryPop()
+    {
+        auto head = mHead.load(std::memory_order_relaxed);
+        if (head == mCachedTail) {
+            mCachedTail = mTail.load(std::memory_order_acquire);
+            if (head == mCachedTail)
+                return std::nullopt;
+        }
+
+        auto& slot = mSlots[head & mMask];
+        std::optional<T> value{std::move(*slot)};
+        slot.reset();
+        mHead.store(head + 1, std::memory_order_release);
+        return value;
+    }
+
+    // Any thread, exact only on the consumer's side
+    [[nodiscard]] bool isEmpty() const
+    {
+        return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] size_t getSize() const
+    {
+        auto tail = mTail.load(std::memory_order_acquire);
+        return tail - std::min(tail, mHead.load(std::memory_order_acquire));
+    }
+
+    [[nodiscard]] size_t getCapacity() const { return mMask + 1; }
+
+private:
+    static size_t roundUp(size_t capacity)
+    {
+        size_t result = 1;
+        while (result < capacity)
+            result <<= 1;
+        return result;
+    }
+
+    static constexpr size_t CACHE_LINE = 64;
+
+    const size_t mMask;
+    std::unique_ptr<std::optional<T>[]> mSlots;
+
+    alignas(CACHE_LINE) std::atomic<size_t> mHead{0}; // next slot to pop, written by the consumer
+    size_t mCachedTail = 0;                           // consumer's view of mTail
+
+    alignas(CACHE_LINE) std::atomic<size_t> mTail{0}; // next slot to push, written by the producer
+    size_t mCachedHead = 0;                           // producer's view of mHead
+};
+
+
+#endif //ADB_LIB_SPSCRING_HPP
@@ -0,0 +1,97 @@
+#ifndef ADB_LIB_TCPTRANSPORT_HPP
+#define ADB_LIB_TCPTRANSPORT_HPP
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "TlsSession.hpp"
+#include "Transport.hpp"
+
+
+// ADB over TCP (adbd's tcpip mode, wireless debugging).
+// One thread owns the socket: it writes queued packets, reads incoming ones and, after STLS,
+// runs all of the encryption and decryption, so callers of send() never do crypto.
+// Packets queued together are coalesced, TLS records go out full instead of one per header.
+class TcpTransport
+        : public Transport
+{
+public:
+    static constexpr uint16_t DEFAULT_PORT = 5555;
+    static constexpr std::chrono::milliseconds HANDSHAKE_TIMEOUT{10000};
+
+public:
+    TcpTransport(const TcpTransport&) = delete;
+    ~TcpTransport() override;
+
+    // host is an IPv4 address. nullptr if the device can't be reached
+    static std::unique_ptr<TcpTransport> make(const std::string& host, uint16_t port = DEFAULT_PORT);
+    // Takes a connected stream socket
+    static std::unique_ptr<TcpTransport> make(int fd);
+
+    [[nodiscard]] bool isTlsActive() const;
+    [[nodiscard]] std::string getCiphersuite() const; // empty until the handshake is done
+
+public: // Transport Interface
+    using Transport::send;
+    void send(APacket&& packet, Completion completion) override;
+    void receive() override;
+    bool startTls(const TlsConfig& config) override;
+
+private:
+    // A packet or the point where the stream switches to TLS
+    struct Outgoing {
+        std::optional<APacket> packet;
+        Completion completion;
+        std::optional<TlsConfig> tlsConfig;
+    };
+
+    explicit TcpTransport(int fd);
+
+    void wake();
+    void run();
+
+    // worker thread only
+    void flushOutgoing();
+    bool writePlain(std::deque<Outgoing>& batch);
+    bool writeTls(std::deque<Outgoing>& batch);
+    bool switchToTls(const TlsConfig& config);
+    bool readAvailable();
+    long readSome(uint8_t* data, size_t size);
+    void deliver();
+    void disconnect();
+
+    const int mFd;
+    int mWakePipe[2] = {-1, -1};
+    std::atomic<bool> mRunning;
+    std::thread mThread;
+
+    std::mutex mOutgoingMutex;
+    std::deque<Outgoing> mOutgoing;
+    bool mStopped = false;  // the worker gave up, sends fail right away
+
+    std::mutex mIncomingMutex;
+    std::deque<APacket> mIncoming;
+    bool mReceiveRequested = false;
+
+    // Worker thread only:
+    TlsSession::UniquePointer mTls;
+    std::vector<uint8_t> mRecordBuffer; // coalesced packets for mbedtls_ssl_write
+    AMessage mHeader = {};
+    size_t mHeaderRead = 0;
+    std::optional<APayload> mPayload;   // payload being read, sized to the header's dataLength
+    size_t mPayloadRead = 0;
+    bool mDisconnected = false;
+    bool mDisconnectReported = false;
+
+    std::atomic<bool> mTlsActive;
+    mutable std::mutex mCiphersuiteMutex;
+    std::string mCiphersuite;
+};
+
+
+#endif //ADB_LIB_TCPTRANSPORT_HPP
@@ -0,0 +1,38 @@
+#ifndef ADB_LIB_THREADPOOL_HPP
+#define ADB_LIB_THREADPOOL_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(size_t threadCount);
+    ThreadPool(const ThreadPool&) = delete;
+    ~ThreadPool(); // mustn't run on a worker, i.e. a task can't destroy its own pool
+
+    bool post(Task task); // false if the pool is stopped, the task is dropped
+    // Finishes queued tasks and joins workers. Called by a task, it joins the other workers only:
+    // the caller's thread may still take queued tasks once the task returns, the destructor joins it
+    void stop();
+
+    [[nodiscard]] size_t getThreadCount() const;
+
+private:
+    void work();
+
+    std::vector<std::thread> mThreads;
+    std::queue<Task> mTasks;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mStopping = false;
+};
+
+
+#endif //ADB_LIB_THREADPOOL_HPP
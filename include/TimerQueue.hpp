@@ -0,0 +1,48 @@
+#ifndef ADB_LIB_TIMERQUEUE_HPP
+#define ADB_LIB_TIMERQUEUE_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+
+// One thread running callbacks at their deadlines. Callbacks must be short, they delay each other
+class TimerQueue {
+public:
+    using Id = uint64_t;
+    using Callback = std::function<void()>;
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr Id INVALID_ID = 0;
+
+public:
+    TimerQueue();
+    TimerQueue(const TimerQueue&) = delete;
+    ~TimerQueue();
+
+    static TimerQueue& shared(); // process-wide queue
+
+    Id schedule(Clock::duration delay, Callback callback);
+    Id scheduleAt(Clock::time_point deadline, Callback callback);
+    bool cancel(Id id); // false if the callback has already run (or is running)
+
+private:
+    void run();
+
+    using Key = std::pair<Clock::time_point, Id>;
+
+    std::mutex mMutex;
+    std::condition_variable mChanged;
+    std::map<Key, Callback> mTimers;
+    std::unordered_map<Id, Clock::time_point> mDeadlines;
+    Id mLastId = INVALID_ID;
+    bool mStopping = false;
+    std::thread mThread;
+};
+
+
+#endif //ADB_LIB_TIMERQUEUE_HPP
@@ -0,0 +1,60 @@
+#ifndef ADB_LIB_TLSSESSION_HPP
+#define ADB_LIB_TLSSESSION_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/x509_crt.h>
+
+#include "Transport.hpp"
+
+
+// mbedTLS session over a connected stream socket.
+// Not thread-safe: one thread does the handshake, the reads and the writes.
+// Writes block until everything is on the wire, reads never block
+class TlsSession {
+public:
+    using UniquePointer = std::unique_ptr<TlsSession>;
+
+    enum Role {
+        CLIENT, // host side of adb's STLS
+        SERVER
+    };
+
+public:
+    // nullptr if the certificate or the key can't be loaded. Doesn't own fd
+    static UniquePointer make(Role role, const Transport::TlsConfig& config, int fd);
+    TlsSession(const TlsSession&) = delete;
+    ~TlsSession();
+
+    bool handshake(std::chrono::milliseconds timeout);
+    bool write(const uint8_t* data, size_t size);
+    long read(uint8_t* data, size_t size); // > 0 bytes read, 0 if no complete record yet, -1 on close or error
+    void closeNotify();
+
+    [[nodiscard]] size_t getBufferedSize() const; // decrypted bytes read() returns without touching the socket
+    [[nodiscard]] std::string getCiphersuite() const;
+
+private:
+    explicit TlsSession(int fd);
+    bool setup(Role role, const Transport::TlsConfig& config);
+
+    static int sendCallback(void* context, const unsigned char* data, size_t size);
+    static int receiveCallback(void* context, unsigned char* data, size_t size);
+
+    const int mFd;
+    mbedtls_ssl_context mSsl;
+    mbedtls_ssl_config mConfig;
+    mbedtls_x509_crt mCertificate;
+    mbedtls_pk_context* mKey = nullptr;
+    mbedtls_entropy_context mEntropy;
+    mbedtls_ctr_drbg_context mRandom;
+};
+
+
+#endif //ADB_LIB_TLSSESSION_HPP
@@ -2,6 +2,10 @@
 #define ADB_LIB_TRANSPORT_HPP
 
 #include <functional>
+#include <future>
+#include <string>
+#include <vector>
+
 #include "APacket.hpp"
 
 
@@ -19,24 +23,53 @@ public:
     using Listener = std::function<void(const APacket*, ErrorCode errorCode)>;
     using UniquePointer = std::unique_ptr<Transport>;
 
+    // Per-packet completion, called once the packet is on the wire (or has failed),
+    // before the send listener. The packet and its payload are released right after the call,
+    // the completion may move the payload out to reuse its buffer.
+    // May be called from send() itself if the packet couldn't be submitted.
+    using Completion = std::function<void(APacket* /*sentPacket*/, ErrorCode errorCode)>;
+
+    // Plain function pointer alternative to the receive Listener, avoids type-erased calls per packet.
+    // The listener may move the payload out of the packet, the transport allocates a new one then
+    using RawListener = void (*)(void* context, APacket*, ErrorCode errorCode);
+
+    // Host's certificate for STLS, its key has to be authorized on the device (adbkey)
+    struct TlsConfig {
+        std::string certificatePath; // PEM
+        std::string privateKeyPath;  // PEM
+    };
+
 public:
-    virtual void send(APacket&& packet) = 0;
+    virtual ~Transport() = default;
+
+    void send(APacket&& packet);
+    virtual void send(APacket&& packet, Completion completion) = 0;
     virtual void receive() = 0;
 
+    // STLS upgrade: packets sent before the call go out in plaintext, the ones after inside TLS.
+    // Returns false if the transport can't do TLS, a failed handshake disconnects the transport
+    virtual bool startTls(const TlsConfig& config);
+
+    std::future<ErrorCode> sendAsync(APacket&& packet);
+    std::future<ErrorCode> sendBatch(std::vector<APacket>&& packets); // resolves with the first error or OK
+
     void setSendListener(Listener);
     void setReceiveListener(Listener);
+    void setRawReceiveListener(RawListener listener, void* context); // takes precedence over the Listener
     void setMaxPayloadSize(size_t maxPayloadSize);
     void resetSendListener();
-    void resetReceiveListener();
+    void resetReceiveListener();       // resets both receive listeners
 
     [[nodiscard]] size_t getMaxPayloadSize() const;
 
 protected:
     void notifySendListener(const APacket*, ErrorCode errorCode);
-    void notifyReceiveListener(const APacket*, ErrorCode errorCode);
+    void notifyReceiveListener(APacket*, ErrorCode errorCode);
 
     Listener mSendListener;
     Listener mReceiveListener;
+    RawListener mRawReceiveListener = nullptr;
+    void* mRawReceiveContext = nullptr;
 
     size_t mMaxPayloadSize = MAX_PAYLOAD_V1;
 };
@@ -0,0 +1,78 @@
+#ifndef ADB_LIB_USBEVENTLOOP_HPP
+#define ADB_LIB_USBEVENTLOOP_HPP
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <ObjLibusb.hpp>
+
+
+// Thread that handles events of its own libusb context
+class UsbEventLoop {
+public:
+    using SharedContext = std::shared_ptr<ObjLibusbContext>;
+    using Clock = std::chrono::steady_clock;
+
+    enum Mode {
+        BLOCKING,   // sleeps in libusb until something happens
+        BUSY_POLL   // spins on non-blocking event handling, occupies a whole core; lowest latency
+    };
+
+    struct Stats {
+        uint64_t busyNanoseconds;   // spent in transfer and hotplug callbacks
+        uint64_t wallNanoseconds;   // since the loop was started
+        uint64_t callbacks;
+    };
+
+    // Measures time spent in a callback and adds it to the loop running on this thread (if any)
+    class BusyScope {
+    public:
+        BusyScope();
+        ~BusyScope();
+
+    private:
+        UsbEventLoop* mLoop;
+        Clock::time_point mStart;
+    };
+
+public:
+    explicit UsbEventLoop(std::vector<int> cpuSet = {}, Mode mode = BLOCKING);
+    UsbEventLoop(const UsbEventLoop&) = delete;
+    ~UsbEventLoop();
+
+    void start();
+    void stop();
+
+    [[nodiscard]] const SharedContext& getContext() const;
+    [[nodiscard]] bool isRunning() const;
+    [[nodiscard]] Mode getMode() const;
+    [[nodiscard]] Stats getStats() const;
+
+    // Fraction of time spent in callbacks since the previous call (or since start)
+    double sampleUtilization();
+
+private:
+    void run();
+    bool applyAffinity();
+
+    SharedContext mContext;
+    std::vector<int> mCpuSet;
+    Mode mMode;
+    std::thread mThread;
+    std::atomic<bool> mRunning;
+
+    Clock::time_point mStartTime;
+    std::atomic<uint64_t> mBusyNanoseconds;
+    std::atomic<uint64_t> mCallbacks;
+
+    Clock::time_point mLastSampleTime;
+    uint64_t mLastSampleBusy;
+
+    static thread_local UsbEventLoop* tCurrentLoop;
+};
+
+
+#endif //ADB_LIB_USBEVENTLOOP_HPP
@@ -0,0 +1,39 @@
+#ifndef ADB_LIB_USBEVENTLOOPPOOL_HPP
+#define ADB_LIB_USBEVENTLOOPPOOL_HPP
+
+#include "UsbEventLoop.hpp"
+
+
+// N event loops, each with its own libusb context. Devices are sharded across the loops,
+// so transfer callbacks (and AdbDevice's packet processing) of different shards run in parallel
+class UsbEventLoopPool {
+public:
+    using SharedPointer = std::shared_ptr<UsbEventLoopPool>;
+
+    struct Config {
+        size_t loopCount;
+        std::vector<std::vector<int>> cpuSets; // CPUs of each loop, reused cyclically; empty - no pinning
+        UsbEventLoop::Mode mode;               // BUSY_POLL should go together with dedicated cpuSets
+    };
+
+public:
+    static SharedPointer make(size_t loopCount);
+    static SharedPointer make(Config config);
+    ~UsbEventLoopPool();
+
+    void stop();
+
+    [[nodiscard]] size_t getLoopCount() const;
+    [[nodiscard]] UsbEventLoop& getLoop(size_t index);
+    [[nodiscard]] size_t shardOf(size_t hash) const;
+
+    std::vector<double> sampleUtilization();
+
+private:
+    explicit UsbEventLoopPool(const Config& config);
+
+    std::vector<std::unique_ptr<UsbEventLoop>> mLoops;
+};
+
+
+#endif //ADB_LIB_USBEVENTLOOPPOOL_HPP
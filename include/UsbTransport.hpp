@@ -42,7 +42,8 @@ public: // Creation
     [[nodiscard]] bool isOk() const;
 
 public: // Transport Interface
-    void send(APacket&& packet) override;
+    using Transport::send;
+    void send(APacket&& packet, Completion completion) override;
     void receive() override;
 
 public: // Callbacks | CALLED FROM LIBUSB's EVENT HANDLING THREAD
@@ -66,12 +67,14 @@ private: // Definitions
     struct TransferPack {
         // Stores a packet to transfer, message and payload transfers and error code
         TransferPack() = default;
-        inline explicit TransferPack(APacket&& packet)
+        inline explicit TransferPack(APacket&& packet, Completion&& completion = {})
             : packet(std::move(packet))
+            , completion(std::move(completion))
             , errorCode(OK)
         {}
 
         APacket packet;
+        Completion completion;
         Transfer::SharedPointer messageTransfer;
         Transfer::SharedPointer payloadTransfer;
         ErrorCode errorCode = OK;
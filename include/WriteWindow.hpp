@@ -0,0 +1,58 @@
+#ifndef ADB_LIB_WRITEWINDOW_HPP
+#define ADB_LIB_WRITEWINDOW_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+#include "PayloadPool.hpp"
+#include "Transport.hpp"
+
+
+// Writes that were handed to a stream but haven't left the transport yet, at most maxInFlight of them.
+// A slot comes with the completion that frees it. The completion also returns the payload's buffer to the pool
+// and records the first failure. Completions hold the window, so the owner may go first
+class WriteWindow
+        : public std::enable_shared_from_this<WriteWindow>
+{
+public:
+    using SharedPointer = std::shared_ptr<WriteWindow>;
+    using FullListener = std::function<void(bool full)>; // under the window's lock, must not block
+
+    static constexpr size_t UNLIMITED = SIZE_MAX;
+
+public:
+    // bufferSize 0 - no pool, payloads go away with their packets
+    static SharedPointer make(size_t maxInFlight, size_t bufferSize = 0, size_t maxCached = 8);
+    WriteWindow(const WriteWindow&) = delete;
+
+    std::optional<Transport::Completion> tryAcquire(); // nullopt if the window is full
+    std::optional<Transport::Completion> acquire();    // waits for a slot, nullopt once a write has failed
+    bool waitForAll();                                 // until nothing is in flight, false if a write has failed
+
+    [[nodiscard]] Transport::ErrorCode getError() const; // the first failure, OK if there was none
+    Transport::ErrorCode takeError();                    // and starts over
+    void setFullListener(FullListener listener);
+
+    PayloadPool& getPool(); // only if made with a bufferSize
+
+private:
+    WriteWindow(size_t maxInFlight, size_t bufferSize, size_t maxCached);
+    Transport::Completion makeCompletion();
+    void release(Transport::ErrorCode errorCode);
+
+    const size_t mMaxInFlight;
+    std::optional<PayloadPool> mPool;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mReleased;
+    size_t mInFlight = 0;
+    Transport::ErrorCode mError = Transport::OK;
+    FullListener mFullListener;
+};
+
+
+#endif //ADB_LIB_WRITEWINDOW_HPP
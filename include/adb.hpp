@@ -22,6 +22,8 @@ constexpr size_t LINUX_MAX_SOCKET_SIZE = 4194304;
 #define A_VERSION_SKIP_CHECKSUM 0x01000001
 #define A_VERSION 0x01000001
 
+#define A_STLS_VERSION 0x01000000
+
 #define ADB_CLASS 0xff
 #define ADB_SUBCLASS 0x42
 #define ADB_PROTOCOL 0x1
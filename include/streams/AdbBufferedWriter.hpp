@@ -0,0 +1,64 @@
+#ifndef ADB_LIB_ADBBUFFEREDWRITER_HPP
+#define ADB_LIB_ADBBUFFEREDWRITER_HPP
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+
+#include "TimerQueue.hpp"
+#include "WriteWindow.hpp"
+#include "streams/AdbOStream.hpp"
+
+
+// Coalesces small writes into maxdata-sized WRTEs, Nagle-style.
+// Pending bytes go out when the payload is full, on flush(), or delay after the first of them was written.
+// reserve()/commit() let callers format straight into the outgoing payload:
+//     auto* buffer = writer.reserve(64);
+//     writer.commit(std::snprintf(reinterpret_cast<char*>(buffer), 64, "%d\n", value));
+// Methods may be called from any thread, but nothing else may be written while a reservation is open
+class AdbBufferedWriter {
+public:
+    static constexpr std::chrono::microseconds DEFAULT_DELAY{500};
+
+public:
+    // maxData is the device's getMaxData(). Zero delay: no timer, bytes wait for a full payload or flush()
+    AdbBufferedWriter(AdbOStream ostream, size_t maxData, std::chrono::microseconds delay = DEFAULT_DELAY);
+    AdbBufferedWriter(const AdbBufferedWriter&) = delete;
+    ~AdbBufferedWriter(); // flushes and waits until the payloads leave the transport
+
+    AdbBufferedWriter& write(const void* data, size_t size);
+    AdbBufferedWriter& operator<<(std::string_view string); // without the NUL operator<< of AdbOStream adds
+
+    // Space for up to size (<= maxData) bytes at the end of the pending payload, flushes first if it doesn't fit.
+    // The timer doesn't flush while the reservation is open
+    uint8_t* reserve(size_t size);
+    void commit(size_t size); // size <= reserved, 0 cancels
+
+    void flush();
+    [[nodiscard]] size_t getPendingSize() const;
+    bool isOpen();
+
+private:
+    // Behind a shared_ptr so the timer can hold it weakly
+    struct State {
+        State(AdbOStream ostream, size_t maxData, std::chrono::microseconds delay);
+
+        void flushLocked();
+        void armTimer(const std::shared_ptr<State>& self);
+
+        mutable std::mutex mutex;
+        AdbOStream ostream;
+        const std::chrono::microseconds delay;
+        WriteWindow::SharedPointer window; // unlimited, counts payloads for the destructor and recycles them
+        std::optional<APayload> pending;
+        size_t reserved = 0;
+        TimerQueue::Id timer = TimerQueue::INVALID_ID;
+    };
+
+    std::shared_ptr<State> mState;
+};
+
+
+#endif //ADB_LIB_ADBBUFFEREDWRITER_HPP
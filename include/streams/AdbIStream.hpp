@@ -1,6 +1,8 @@
 #ifndef ADB_LIB_ADBISTREAM_HPP
 #define ADB_LIB_ADBISTREAM_HPP
 
+#include <optional>
+
 #include "AdbStreamBase.hpp"
 
 
@@ -10,14 +12,64 @@ public:
 
     AdbIStream& operator>> (std::string& string);
     AdbIStream& operator>> (APayload& payload);
+    std::optional<APayload> tryRead(); // nullopt if there's nothing queued, never blocks
+    // nullopt if nothing came in time or the stream is closed and drained (see isOpen)
+    std::optional<APayload> readFor(std::chrono::nanoseconds timeout);
+
+    // Zero-copy read: waits for a payload and lends its bytes to consumer(const uint8_t* data, size_t size).
+    // The bytes are valid during the call only. Returns false if the stream is closed and drained
+    template<class Consumer>
+    bool read(Consumer&& consumer);
+
+    // Copies up to size bytes, the rest of the payload is kept for the next read of any kind.
+    // Waits for data, returns 0 if the stream is closed and drained
+    size_t readInto(void* buffer, size_t size);
 
     bool isOpen() const;
     bool isEmpty() const;
     void close();
 
+    // Low-latency mode: a reader spins this long for data before the adaptive spin-then-park (0 - adaptive spin only)
+    void setSpinBeforePark(std::chrono::nanoseconds duration);
+
+    // Bounds the bytes queued for the reader, see AdbStreamBase::Watermarks.
+    // Streams start with the device's watermarks, see AdbDevice::setStreamWatermarks
+    void setWatermarks(AdbStreamBase::Watermarks watermarks);
+    // Shorthand: true - the device sends the next payload only after this one is read (ACK_ON_READ),
+    // false - every payload is acknowledged on arrival (UNBOUNDED)
+    void setAckOnRead(bool ackOnRead);
+
+    // Called on the transport's event thread when a payload arrives or the stream closes, must not block
+    void setDataListener(AdbStreamBase::DataListener listener);
+
+    // Reactor mode for the whole stream, both directions, see AdbStreamBase::Handlers.
+    // To miss nothing, call it on the event thread (in an OpenHandler) or open with AdbDevice::openAsync(destination, handlers, ...)
+    void setHandlers(AdbStreamBase::Handlers handlers);
+
 private:
-    std::shared_ptr<AdbStreamBase> mBasePtr;
+    APayload next(); // leftover of readInto() first, then the queue
 
+    std::shared_ptr<AdbStreamBase> mBasePtr;
+    std::optional<APayload> mLeftover; // partially read by readInto()
+    size_t mLeftoverOffset = 0;
 };
 
+template<class Consumer>
+bool AdbIStream::read(Consumer&& consumer)
+{
+    if (mLeftover) {
+        consumer(static_cast<const uint8_t*>(mLeftover->getBuffer() + mLeftoverOffset),
+                 mLeftover->getSize() - mLeftoverOffset);
+        mLeftover.reset();
+        return true;
+    }
+
+    auto payload = mBasePtr->getPayload();
+    if (payload.getSize() == 0) // closed
+        return false;
+
+    consumer(static_cast<const uint8_t*>(payload.getBuffer()), payload.getSize());
+    return true;
+}
+
 #endif //ADB_LIB_ADBISTREAM_HPP
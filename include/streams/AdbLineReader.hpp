@@ -0,0 +1,42 @@
+#ifndef ADB_LIB_ADBLINEREADER_HPP
+#define ADB_LIB_ADBLINEREADER_HPP
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "streams/AdbIStream.hpp"
+
+
+// Splits an input stream into records: lines of `pm list`, `getprop`, `dumpsys` and the like.
+// Delimiters are found with memchr, vectorized by the C library. Records are views into the received payload,
+// only a record spanning payloads is stitched together, in a buffer reused from record to record.
+//
+//     AdbLineReader lines(streams->istream);
+//     while (auto line = lines.next())
+//         handle(*line);
+class AdbLineReader {
+public:
+    // trimCarriageReturn: drop '\r' before the delimiter, shell: streams without ",raw" end lines with "\r\n"
+    explicit AdbLineReader(AdbIStream& stream, char delimiter = '\n', bool trimCarriageReturn = true);
+    AdbLineReader(const AdbLineReader&) = delete;
+
+    // The next record without its delimiter, waits for data. The view is valid until the next call.
+    // nullopt once the stream is closed and drained, the last record may have no delimiter
+    std::optional<std::string_view> next();
+
+private:
+    std::string_view trim(std::string_view record) const;
+
+    AdbIStream& mStream;
+    const char mDelimiter;
+    const bool mTrimCarriageReturn;
+
+    std::optional<APayload> mPayload; // records are cut out of it
+    size_t mOffset = 0;
+    std::string mSpanning;            // beginning of a record from previous payloads
+    bool mSpanningReturned = false;   // the last record was mSpanning, it's cleared on the next call
+};
+
+
+#endif //ADB_LIB_ADBLINEREADER_HPP
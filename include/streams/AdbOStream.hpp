@@ -11,6 +11,10 @@ public:
     AdbOStream& operator<< (const std::string_view& string);
     AdbOStream& operator<< (APayload payload);
 
+    // Completion is called when the payload's WRTE leaves the transport
+    AdbOStream& write(APayload payload, Transport::Completion completion);
+    std::future<Transport::ErrorCode> writeAsync(APayload payload);
+
     bool isOpen();
     void close();
 
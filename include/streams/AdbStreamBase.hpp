@@ -1,13 +1,21 @@
 #ifndef ADB_LIB_ADBSTREAMBASE_HPP
 #define ADB_LIB_ADBSTREAMBASE_HPP
 
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <queue>
 #include <mutex>
 #include <atomic>
 #include <condition_variable>
 
 #include "APayload.hpp"
+#include "Parker.hpp"
+#include "SpscRing.hpp"
+#include "Transport.hpp"
+#include "WriteWindow.hpp"
 
 class AdbDevice;
 
@@ -16,15 +24,35 @@ public:
     using SharedDevice = std::shared_ptr<AdbDevice>;
     using WeakDevice = SharedDevice::weak_type;
 
+    // Backpressure: OKAY for a WRTE is held back once more than high bytes wait for the reader,
+    // it goes out when the reader drains the queue to low bytes. The device sends nothing meanwhile
+    struct Watermarks {
+        size_t high;
+        size_t low;
+    };
+
+    static constexpr Watermarks DEFAULT_WATERMARKS{2 * 1024 * 1024, 512 * 1024};
+    static constexpr Watermarks ACK_ON_READ{0, 0};               // one payload queued at most
+    static constexpr Watermarks UNBOUNDED{SIZE_MAX, SIZE_MAX};   // OKAY right on arrival while the queue has room
+
+    // Reactor mode: the transport's event thread calls these directly, payloads skip the reader's queue.
+    // Handlers must not block, they hold up every stream of the transport.
+    // Handlers holding the stream's own handles keep it alive until it's closed
+    struct Handlers {
+        std::function<void(APayload&& payload)> onData; // owns the payload, the device gets OKAY when it returns
+        std::function<void()> onWritable;               // an OKAY left no writes queued, the next one goes out now
+        std::function<void()> onClose;                  // once, closed by either side or on disconnect
+    };
+
+    using DataListener = std::function<void()>;
+
     AdbStreamBase(const AdbStreamBase&) = delete;
     AdbStreamBase(AdbStreamBase&&) = delete;
     ~AdbStreamBase();
     [[nodiscard]] bool isOpen() const;
 
 protected: // general
-    using Queue = std::deque<APayload>;
-
-    AdbStreamBase(WeakDevice pointer, uint32_t localId, uint32_t remoteId);
+    AdbStreamBase(WeakDevice pointer, uint32_t localId, uint32_t remoteId, Watermarks watermarks);
     void close();
     SharedDevice lockDeviceIfOpen();
 
@@ -36,22 +64,62 @@ protected: // general
     friend AdbDevice;
 
 protected: // outgoing
-    void send(APayload&& payload);
+    struct Outgoing {
+        APayload payload;
+        Transport::Completion completion;
+        size_t offset = 0; // bytes already sent as chunks
+    };
+    using OutgoingQueue = std::deque<Outgoing>;
+
+    // Payloads larger than the device's maxdata go out as several WRTEs, one per OKAY.
+    // The completion is called once, with the last chunk
+    void send(APayload&& payload, Transport::Completion completion = {});
     void readyToSend();
+    void sendFront(const SharedDevice& device); // under mOutgoingMutex
 
     bool mReadyToSend;
-    Queue mOutgoingQueue;
+    OutgoingQueue mOutgoingQueue;
     std::mutex mOutgoingMutex;
+    WriteWindow::SharedPointer mChunks;           // chunk buffers and the front payload's first failed chunk,
+                                                  // created with the first payload over maxdata
 
     friend class AdbOStream;
 
 protected: // incoming
-    void received(const APayload& payload);
-    APayload getPayload();
+    // The transport's event thread produces, readers consume one at a time (mConsumerMutex).
+    // Neither side locks on the data path unless a listener or handlers are set
+    static constexpr size_t INCOMING_CAPACITY = 256; // payloads. A full ring holds OKAY back, as the high watermark does
 
-    std::condition_variable mReceived;
-    Queue mIncomingQueue;
-    std::mutex mIncomingMutex;
+    bool received(APayload&& payload); // true if OKAY is due right away
+    bool enqueue(APayload&& payload);  // true if OKAY is due right away
+    APayload getPayload();
+    std::optional<APayload> tryGetPayload(); // never blocks
+    std::optional<APayload> getPayloadFor(std::chrono::nanoseconds timeout); // nullopt on timeout or close
+    std::optional<APayload> popFront(); // acknowledges once the queue is drained to the low watermark
+    bool waitForData(Parker::Clock::time_point deadline); // false on timeout
+    void spinForData();
+    void setDataListener(DataListener listener);
+    void notifyDataListener();
+    void setSpinBeforePark(std::chrono::nanoseconds duration);
+    void setWatermarks(Watermarks watermarks);
+    void setHandlers(Handlers handlers); // payloads queued before go to onData first, on the calling thread
+    void drainToHandlers(std::unique_lock<std::mutex>& lock); // under mIncomingMutex, relocks before returning
+    std::shared_ptr<const Handlers> getHandlers();
+
+    SpscRing<APayload> mIncoming;
+    std::mutex mConsumerMutex;              // the producer never takes it
+    Parker mParker;                         // readers sleep here, the producer notifies
+    std::chrono::nanoseconds mSpinDuration; // readers spin this long before the parker's own adaptive spin
+    std::atomic<size_t> mQueuedBytes;
+    std::atomic<size_t> mHighWatermark;
+    std::atomic<size_t> mLowWatermark;
+    std::atomic<bool> mAckOwed;             // the last WRTE isn't acknowledged
+
+    std::mutex mIncomingMutex;              // listener and handlers
+    std::atomic<bool> mHasCallbacks;        // the producer takes mIncomingMutex only if set
+    DataListener mDataListener;             // guarded by mIncomingMutex
+    std::shared_ptr<const Handlers> mHandlers; // reactor mode, guarded by mIncomingMutex
+    bool mDraining;                         // the queue is being handed over to onData, guarded by mIncomingMutex
 
     friend class AdbIStream;
 };
@@ -0,0 +1,48 @@
+#ifndef ADB_LIB_ADBSTREAMBUF_HPP
+#define ADB_LIB_ADBSTREAMBUF_HPP
+
+#include <optional>
+#include <streambuf>
+
+#include "WriteWindow.hpp"
+#include "streams/AdbIStream.hpp"
+#include "streams/AdbOStream.hpp"
+
+
+// std::streambuf over a pair of ADB streams, for iostream-based parsers and archivers:
+//     AdbStreamBuf buffer(std::move(streams->istream), std::move(streams->ostream), device->getMaxData());
+//     std::istream in(&buffer);
+//
+// The get area is the received payload itself, nothing is copied on refill.
+// The put area is a payload of chunkSize bytes (the device's maxdata) that is sent whole when it fills up,
+// sent buffers come back through a pool. At most maxInFlight chunks wait for the device, writers block then
+class AdbStreamBuf
+        : public std::streambuf
+{
+public:
+    AdbStreamBuf(AdbIStream istream, AdbOStream ostream, size_t chunkSize, size_t maxInFlight = 4);
+    AdbStreamBuf(const AdbStreamBuf&) = delete;
+    ~AdbStreamBuf() override; // flushes
+
+    bool isOpen() const;
+
+protected:
+    int_type underflow() override;
+    int_type overflow(int_type ch) override;
+    int sync() override;
+    std::streamsize showmanyc() override;
+
+private:
+    bool flushPutArea();
+    void resetPutArea();
+
+    AdbIStream mIStream;
+    AdbOStream mOStream;
+
+    std::optional<APayload> mGetPayload; // backs the get area
+    std::optional<APayload> mPutPayload; // backs the put area
+    WriteWindow::SharedPointer mWindow;  // chunks sent but not on the wire yet, and their buffers
+};
+
+
+#endif //ADB_LIB_ADBSTREAMBUF_HPP
@@ -0,0 +1,56 @@
+#ifndef ADB_LIB_ADBSTREAMFD_HPP
+#define ADB_LIB_ADBSTREAMFD_HPP
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+
+#include "AdbDevice.hpp"
+#include "WriteWindow.hpp"
+
+
+// Readiness of an ADB stream as file descriptors, for epoll/poll/libuv/asio loops. Linux only.
+// Both fds are eventfds, wait for them to become readable (EPOLLIN), never read or write them:
+//  - getReadFd() while payloads are queued or the stream is closed, like POLLIN | POLLHUP;
+//  - getWriteFd() while tryWrite() is accepted: fewer than maxInFlight writes haven't left the transport yet.
+// Level-triggered. The stream's data listener is taken over. Reads belong to one thread, writes to any.
+// Remove the fds from the loop before the object is destroyed
+class AdbStreamFd {
+public:
+    using UniquePointer = std::unique_ptr<AdbStreamFd>;
+
+public:
+    static UniquePointer make(AdbDevice::Streams streams, size_t maxInFlight = 1); // nullptr if eventfd fails
+    AdbStreamFd(const AdbStreamFd&) = delete;
+    ~AdbStreamFd(); // closes the stream, the fds are closed once late callbacks are done with them
+
+    [[nodiscard]] int getReadFd() const;
+    [[nodiscard]] int getWriteFd() const;
+
+    std::optional<APayload> tryRead(); // never blocks, nullopt once drained
+    bool tryWrite(APayload payload);   // never blocks, false if too many writes are in flight or the stream is closed
+    [[nodiscard]] bool isOpen() const;
+
+private:
+    // The eventfds, closed with the last of the listener, the window and the object
+    struct State {
+        State(int readFd, int writeFd);
+        ~State();
+
+        void signal(int fd);
+        void clear(int fd);
+
+        const int readFd;
+        const int writeFd;
+    };
+
+    AdbStreamFd(AdbDevice::Streams&& streams, std::shared_ptr<State> state, size_t maxInFlight);
+    void updateReadFd();
+
+    AdbDevice::Streams mStreams;
+    std::shared_ptr<State> mState;
+    WriteWindow::SharedPointer mWindow; // toggles the write fd as it fills up and opens again
+};
+
+
+#endif //ADB_LIB_ADBSTREAMFD_HPP
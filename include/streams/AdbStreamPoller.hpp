@@ -0,0 +1,53 @@
+#ifndef ADB_LIB_ADBSTREAMPOLLER_HPP
+#define ADB_LIB_ADBSTREAMPOLLER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "streams/AdbIStream.hpp"
+
+
+// poll() for ADB streams: one thread waits on any number of input streams of any number of devices.
+// Level-triggered: a stream is ready while it has data to read or is closed, like POLLIN | POLLHUP.
+// A stream in the poller has its data listener taken over. It must outlive its registration
+class AdbStreamPoller {
+public:
+    using Key = uint64_t; // chosen by the caller, identifies the stream in results
+
+public:
+    AdbStreamPoller();
+    AdbStreamPoller(const AdbStreamPoller&) = delete;
+    ~AdbStreamPoller(); // removes all streams
+
+    bool add(AdbIStream& stream, Key key); // false if key is taken
+    bool remove(Key key);
+    [[nodiscard]] size_t size() const;
+
+    // Keys of ready streams, empty on timeout. Must not be called from a transport's event thread
+    std::vector<Key> wait(std::chrono::milliseconds timeout);
+    std::vector<Key> wait();
+
+private:
+    struct Signals {
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::unordered_set<Key> signalled; // got data or closed since the last wait
+    };
+
+    static bool isReady(const AdbIStream& stream);
+    template<class Wait>
+    std::vector<Key> collect(Wait&& wait); // under mSignals->mutex
+
+    std::shared_ptr<Signals> mSignals;
+    std::unordered_map<Key, AdbIStream*> mStreams; // guarded by mSignals->mutex
+    std::vector<Key> mLastReady;                   // checked again by the next wait, guarded by mSignals->mutex
+};
+
+
+#endif //ADB_LIB_ADBSTREAMPOLLER_HPP
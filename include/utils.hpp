@@ -18,7 +18,9 @@ namespace utils {
 
         int generateRandomBytes(void* /* ignored */, unsigned char* output, size_t outputLen);
 
+        // nullptr if the file can't be parsed, release the context with freePkContext
         mbedtls_pk_context* makePkContextFromPem(const std::string& filepath);
+        void freePkContext(mbedtls_pk_context* ctx);
 
         // signs SHA1 hash
         bool sign(mbedtls_pk_context* ctx,
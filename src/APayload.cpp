@@ -2,6 +2,8 @@
 #include <memory>
 #include <cassert>
 #include <algorithm>
+#include <cstdlib>
+#include <utility>
 
 APayload::APayload(size_t bufferSize)
     : mBuffer(static_cast<uint8_t*>(std::malloc(bufferSize)))
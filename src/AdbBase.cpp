@@ -55,7 +55,7 @@ bool AdbBase::checkPacketValidity(const APacket& packet) const
     return true;
 }
 
-void AdbBase::sendConnect(const std::string& systemType, const FeatureSet& featureSet)
+void AdbBase::sendConnect(const std::string& systemType, const FeatureSet& featureSet, SendCompletion completion)
 {
     std::string identity = systemType + "::"; // TODO: Add possibility to add Serial number to the identity string
     identity += "features=" + Features::setToString(featureSet);
@@ -65,24 +65,29 @@ void AdbBase::sendConnect(const std::string& systemType, const FeatureSet& featu
     packet.updateMessageDataLength();
     packet.computeChecksum(); // Checksum has to be computed regardless of version
 
-    mTransport->send(std::move(packet));
+    mTransport->send(std::move(packet), std::move(completion));
 }
 
-void AdbBase::sendTls(AdbBase::Arg type, AdbBase::Arg version)
+bool AdbBase::startTls(const Transport::TlsConfig& config)
 {
-    mTransport->send(APacket(AMessage::make(A_STLS, type, version)));
+    return mTransport->startTls(config);
 }
 
-void AdbBase::sendAuth(AdbBase::AuthType type, APayload payload)
+void AdbBase::sendTls(AdbBase::Arg type, AdbBase::Arg version, SendCompletion completion)
+{
+    mTransport->send(APacket(AMessage::make(A_STLS, type, version)), std::move(completion));
+}
+
+void AdbBase::sendAuth(AdbBase::AuthType type, APayload payload, SendCompletion completion)
 {
     APacket packet(AMessage::make(A_AUTH, type, 0));
     packet.movePayloadIn(std::move(payload));
     packet.updateMessageDataLength();
     packet.computeChecksum(); // Checksum has to be computed regardless of version
-    mTransport->send(std::move(packet));
+    mTransport->send(std::move(packet), std::move(completion));
 }
 
-void AdbBase::sendOpen(AdbBase::Arg localStreamId, APayload payload)
+void AdbBase::sendOpen(AdbBase::Arg localStreamId, APayload payload, SendCompletion completion)
 {
     APacket packet(AMessage::make(A_OPEN, localStreamId, 0));
     packet.movePayloadIn(std::move(payload));
@@ -91,15 +96,16 @@ void AdbBase::sendOpen(AdbBase::Arg localStreamId, APayload payload)
     if (mVersion <= A_VERSION_SKIP_CHECKSUM)
         packet.computeChecksum();
 
-    mTransport->send(std::move(packet));
+    mTransport->send(std::move(packet), std::move(completion));
 }
 
-void AdbBase::sendReady(AdbBase::Arg localStreamId, AdbBase::Arg remoteStreamId)
+void AdbBase::sendReady(AdbBase::Arg localStreamId, AdbBase::Arg remoteStreamId, SendCompletion completion)
 {
-    mTransport->send(APacket(AMessage::make(A_OKAY, localStreamId, remoteStreamId)));
+    mTransport->send(APacket(AMessage::make(A_OKAY, localStreamId, remoteStreamId)), std::move(completion));
 }
 
-void AdbBase::sendWrite(AdbBase::Arg localStreamId, AdbBase::Arg remoteStreamId, APayload payload)
+void AdbBase::sendWrite(AdbBase::Arg localStreamId, AdbBase::Arg remoteStreamId, APayload payload,
+                        SendCompletion completion)
 {
     APacket packet(AMessage::make(A_WRTE, localStreamId, remoteStreamId));
     packet.movePayloadIn(std::move(payload));
@@ -108,12 +114,12 @@ void AdbBase::sendWrite(AdbBase::Arg localStreamId, AdbBase::Arg remoteStreamId,
     if (mVersion < A_VERSION_SKIP_CHECKSUM)
         packet.computeChecksum();
 
-    mTransport->send(std::move(packet));
+    mTransport->send(std::move(packet), std::move(completion));
 }
 
-void AdbBase::sendClose(AdbBase::Arg localStreamId, AdbBase::Arg remoteStreamId)
+void AdbBase::sendClose(AdbBase::Arg localStreamId, AdbBase::Arg remoteStreamId, SendCompletion completion)
 {
-    mTransport->send(APacket(AMessage::make(A_CLSE, localStreamId, remoteStreamId)));
+    mTransport->send(APacket(AMessage::make(A_CLSE, localStreamId, remoteStreamId)), std::move(completion));
 }
 
 AdbBase::~AdbBase()
@@ -138,6 +144,10 @@ void AdbBase::setPacketListener(AdbBase::PacketListener listener)
 void AdbBase::resetPacketListener()
 {
     mPacketListener = {};
+    if (mPacketHandler) {
+        mPacketHandler = nullptr;
+        mTransport->setRawReceiveListener(nullptr, nullptr); // back to the std::function listener
+    }
 }
 
 void AdbBase::setErrorListener(AdbBase::ErrorListener listener)
@@ -153,6 +163,7 @@ void AdbBase::resetErrorListener()
 AdbBase::AdbBase(AdbBase::UniqueTransport&& pointer, uint32_t version)
         : mTransport(std::move(pointer))
         , mVersion(0)
+        , mReportSuccessfulSends(false)
 {
     setVersion(version);
     setup();
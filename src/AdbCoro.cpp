@@ -0,0 +1,103 @@
+#include "AdbCoro.hpp"
+
+
+namespace AdbCoro {
+
+    Executor::Executor(size_t threadCount)
+        : mPool(threadCount)
+    {}
+
+    void Executor::post(std::coroutine_handle<> handle)
+    {
+        if (!mPool.post([handle] { handle.resume(); }))
+            handle.resume();
+    }
+
+    void Executor::stop()
+    {
+        mPool.stop();
+    }
+
+
+    ConnectAwaiter::ConnectAwaiter(Executor& executor, AdbDevice::SharedPointer device,
+                                   std::chrono::milliseconds timeout)
+        : mExecutor(executor)
+        , mDevice(std::move(device))
+        , mTimeout(timeout)
+    {}
+
+    void ConnectAwaiter::await_suspend(std::coroutine_handle<> handle)
+    {
+        mDevice->connectAsync(mTimeout, [this, handle] (AdbDevice::ConnectionState state) {
+            mResult = state;
+            mExecutor.post(handle);
+        });
+    }
+
+
+    OpenAwaiter::OpenAwaiter(Executor& executor, AdbDevice::SharedPointer device, std::string destination)
+        : mExecutor(executor)
+        , mDevice(std::move(device))
+        , mDestination(std::move(destination))
+    {}
+
+    void OpenAwaiter::await_suspend(std::coroutine_handle<> handle)
+    {
+        mDevice->openAsync(mDestination, [this, handle] (std::optional<AdbDevice::Streams> streams) {
+            mResult = std::move(streams);
+            mExecutor.post(handle);
+        });
+    }
+
+
+    ReadAwaiter::ReadAwaiter(Executor& executor, AdbIStream& stream)
+        : mExecutor(executor)
+        , mStream(stream)
+    {}
+
+    bool ReadAwaiter::await_ready()
+    {
+        mResult = mStream.tryRead();
+        return mResult || !mStream.isOpen();
+    }
+
+    bool ReadAwaiter::await_suspend(std::coroutine_handle<> handle)
+    {
+        auto wake = std::make_shared<Wake>(mExecutor, handle);
+        mStream.setDataListener([wake] {
+            if (wake->state.exchange(Wake::FIRED) == Wake::ARMED)
+                wake->executor.post(wake->handle);
+        });
+
+        // Data may have come in before the listener was set. Nothing resumes the coroutine until ARMED
+        if (!mStream.isEmpty() || !mStream.isOpen())
+            return false;
+
+        auto expected = Wake::ARMING;
+        return wake->state.compare_exchange_strong(expected, Wake::ARMED); // fails if the listener fired meanwhile
+    }
+
+    std::optional<APayload> ReadAwaiter::await_resume()
+    {
+        if (mResult)
+            return std::move(mResult);
+
+        mStream.setDataListener({});
+        return mStream.tryRead();
+    }
+
+
+    WriteAwaiter::WriteAwaiter(Executor& executor, AdbOStream& stream, APayload&& payload)
+        : mExecutor(executor)
+        , mStream(stream)
+        , mPayload(std::move(payload))
+    {}
+
+    void WriteAwaiter::await_suspend(std::coroutine_handle<> handle)
+    {
+        mStream.write(std::move(*mPayload), [this, handle] (APacket*, Transport::ErrorCode errorCode) {
+            mResult = errorCode;
+            mExecutor.post(handle);
+        });
+    }
+}
@@ -1,41 +1,137 @@
 #include "AdbDevice.hpp"
 
+#include <algorithm>
 #include <cassert>
-#include <fstream>
-#include <filesystem>
 #include <iostream>
+#include <utility>
 
 #include "utils.hpp"
 #include "AdbStreams.hpp"
+#include "KeyStore.hpp"
 
 
 AdbDevice::AdbDevice(AdbDevice::UniqueTransport &&transport)
     : AdbBase(std::move(transport), A_VERSION)
-    , mLastLocalId(0)
     , mConnectionState(OFFLINE)
     , mSystemType("none")
 {
-    setPacketListener([this](const APacket& packet){
-        this->packetListener(packet);
-    });
+    setPacketHandler(*this);
 
     setErrorListener([this](int errorCode, const APacket* packet, bool incomingPacket) {
         this->errorListener(errorCode, packet, incomingPacket);
     });
 }
 
-void AdbDevice::connect() {
-    assert(getConnectionState() == OFFLINE);
+bool AdbDevice::connect(std::chrono::milliseconds timeout) {
+    connectAsync(timeout).wait();
+    return isConnected();
+}
 
-    sendConnect("host", mFeatureSet);
+void AdbDevice::connectAsync(std::chrono::milliseconds timeout, ConnectCallback callback)
+{
+    std::unique_lock lock(mConnectMutex);
+    if (isConnected()) {
+        lock.unlock();
+        callback(mConnectionState);
+        return;
+    }
+
+    mConnectCallbacks.push_back(std::move(callback));
+    if (mConnecting)
+        return;
+
+    mConnecting = true;
+    auto attempt = ++mConnectAttempt;
+    orderKeys();
+    mPublicIsAlreadyTried = false;
     setConnectionState(CONNECTING);
 
-    // TODO: Replace with something sane
-    std::mutex mutex;
-    std::unique_lock lock(mutex);
-    mConnected.wait(lock);
-    if (!isConnected())
-        setConnectionState(OFFLINE);
+    if (timeout != NO_TIMEOUT) {
+        std::weak_ptr<AdbDevice> weak = weak_from_this();
+        mConnectTimer = TimerQueue::shared().schedule(timeout, [weak, attempt] {
+            if (auto self = weak.lock())
+                self->connectTimedOut(attempt);
+        });
+    }
+    lock.unlock();
+
+    sendConnect("host", mFeatureSet);
+}
+
+std::future<AdbDevice::ConnectionState> AdbDevice::connectAsync(std::chrono::milliseconds timeout)
+{
+    auto promise = std::make_shared<std::promise<ConnectionState>>();
+    auto future = promise->get_future();
+    connectAsync(timeout, [promise](ConnectionState state) {
+        promise->set_value(state);
+    });
+    return future;
+}
+
+std::vector<AdbDevice::ConnectionState> AdbDevice::connectAll(const std::vector<SharedPointer>& devices,
+                                                              std::chrono::milliseconds timeout,
+                                                              const ConnectResultListener& listener)
+{
+    struct Results {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::vector<ConnectionState> states;
+        size_t remaining;
+    };
+
+    auto results = std::make_shared<Results>();
+    results->states.resize(devices.size(), OFFLINE);
+    results->remaining = devices.size();
+
+    for (size_t i = 0; i < devices.size(); ++i) {
+        const auto& device = devices[i];
+        device->connectAsync(timeout, [results, device, i, &listener](ConnectionState state) {
+            if (listener)
+                listener(device, state);
+
+            std::unique_lock lock(results->mutex);
+            results->states[i] = state;
+            if (--results->remaining == 0)
+                results->cv.notify_all();
+        });
+    }
+
+    std::unique_lock lock(results->mutex);
+    results->cv.wait(lock, [&results] { return results->remaining == 0; });
+    return std::move(results->states);
+}
+
+void AdbDevice::finishConnecting()
+{
+    std::unique_lock lock(mConnectMutex);
+    if (!mConnecting)
+        return;
+
+    mConnecting = false;
+    auto callbacks = std::move(mConnectCallbacks);
+    mConnectCallbacks.clear();
+    auto timer = std::exchange(mConnectTimer, TimerQueue::INVALID_ID);
+    ConnectionState state = mConnectionState;
+    lock.unlock();
+
+    if (timer != TimerQueue::INVALID_ID)
+        TimerQueue::shared().cancel(timer);
+
+    for (auto& callback : callbacks)
+        callback(state);
+}
+
+void AdbDevice::connectTimedOut(uint64_t attempt)
+{
+    std::unique_lock lock(mConnectMutex);
+    if (!mConnecting || attempt != mConnectAttempt)
+        return;
+
+    mConnectTimer = TimerQueue::INVALID_ID;
+    setConnectionState(OFFLINE); // late CNXN/AUTH packets are ignored from now on
+    lock.unlock();
+
+    finishConnecting();
 }
 
 bool AdbDevice::isConnected() const {
@@ -52,26 +148,8 @@ bool AdbDevice::isConnected() const {
     }
 }
 
-void AdbDevice::packetListener(const APacket &packet) {
-    auto command = packet.getMessage().command;
-
-    if (command == A_CNXN)
-        processConnect(packet);
-    else if (command == A_OPEN)
-        processOpen(packet);
-    else if (command == A_OKAY)
-        processReady(packet);
-    else if (command == A_CLSE)
-        processClose(packet);
-    else if (command == A_WRTE)
-        processWrite(packet);
-    else if (command == A_AUTH)
-        processAuth(packet);
-    else if (command == A_STLS)
-        processTls(packet);
-    else
-        std::cerr << "AdbDevice: received unknown command: " << packet.getMessage().viewCommand() << std::endl;
-
+void AdbDevice::processUnknown(const APacket& packet) {
+    std::cerr << "AdbDevice: received unknown command: " << packet.getMessage().viewCommand() << std::endl;
 }
 
 bool AdbDevice::isAwaitingConnection() const
@@ -99,6 +177,7 @@ void AdbDevice::processConnect(const APacket& packet) {
 
         if (!setSystemType(tokens[0])) {
             setConnectionState(OFFLINE);
+            finishConnecting();
             return;
         }
 
@@ -123,15 +202,41 @@ void AdbDevice::processConnect(const APacket& packet) {
                 // TODO: Report unknown property (?)
             }
         }
-        mConnected.notify_one();
+        std::unique_lock lock(mConnectMutex);
+        auto signedKey = mLastSignedKey;
+        lock.unlock();
+
+        if (!signedKey.empty())
+            KeyStore::shared().setAcceptedKey(mSerial, signedKey);
+        finishConnecting();
     } // !isAwaitingConnection()
     // TODO: Else
 }
 
-// TODO: Process Packets
-void AdbDevice::processOpen(const APacket&)
+void AdbDevice::processOpen(const APacket& packet)
 {
+    assert(packet.getMessage().command == A_OPEN);
+    auto remoteId = packet.getMessage().arg0;
+
+    std::string destination;
+    if (packet.hasPayload()) {
+        auto view = packet.getPayload().toStringView();
+        destination = view.substr(0, view.find('\0'));
+    }
+
+    auto handler = findOpenHandler(destination);
+    auto localId = handler ? mStreams.insert(StreamSlot{}) : SlotTable<StreamSlot>::INVALID_ID;
+    if (localId == SlotTable<StreamSlot>::INVALID_ID) {
+        sendClose(0, remoteId);
+        return;
+    }
 
+    std::shared_ptr<AdbStreamBase> base{new AdbStreamBase{shared_from_this(), localId, remoteId, getStreamWatermarks()}};
+    mStreams.exchange(localId, StreamSlot{base, {}});
+    sendReady(localId, remoteId);
+
+    handler(destination, Streams{AdbIStream(base),
+                                 AdbOStream(base)});
 }
 
 void AdbDevice::processReady(const APacket& packet)
@@ -140,20 +245,36 @@ void AdbDevice::processReady(const APacket& packet)
     const auto& message = packet.getMessage();
     auto localId = message.arg1;
 
-    // find if it is an active stream
-    auto activeIt = mActiveStreams.find(localId);
-    if (activeIt != mActiveStreams.end()) {
-        auto stream = activeIt->second.lock();
-        if (stream)
-            stream->readyToSend();
+    std::shared_ptr<AdbStreamBase> stream;
+    bool pending = false;
+    mStreams.read(localId, [&](const StreamSlot& slot) {
+        pending = static_cast<bool>(slot.pendingOpen);
+        if (!pending)
+            stream = slot.stream.lock();
+    });
+
+    // an active stream
+    if (stream) {
+        stream->readyToSend();
         return;
     }
 
-    auto awaitingIt = mAwaitingStreams.find(localId);
-    if (awaitingIt != mAwaitingStreams.end()) {
-        awaitingIt->second.remoteId = message.arg0;
-        awaitingIt->second.cv.notify_one();
+    if (!pending)
+        return;
+
+    std::shared_ptr<AdbStreamBase> base{new AdbStreamBase{shared_from_this(), localId, message.arg0, getStreamWatermarks()}};
+    auto old = mStreams.exchange(localId, StreamSlot{base, {}});
+    if (!old) { // the open was failed in the meantime
+        sendClose(localId, message.arg0);
+        return;
     }
+
+    // WRTEs come on this thread after this packet, none is queued yet
+    if (old->handlers)
+        base->setHandlers(std::move(*old->handlers));
+
+    old->pendingOpen(Streams{AdbIStream(base),
+                             AdbOStream(base)});
 }
 
 void AdbDevice::processClose(const APacket& packet)
@@ -161,74 +282,104 @@ void AdbDevice::processClose(const APacket& packet)
     const auto& message = packet.getMessage();
     assert(message.command == A_CLSE);
 
-    auto localId = message.arg1;
-    std::unique_lock lock(mStreamsMutex);
-
-    auto awaitingIt = mAwaitingStreams.find(localId);
-    if (awaitingIt != mAwaitingStreams.end()) {
-        auto& awaitingStruct = awaitingIt->second;
-        awaitingStruct.rejected = true;
-        awaitingStruct.remoteId = 0;
-        awaitingStruct.cv.notify_one();
+    auto slot = mStreams.erase(message.arg1);
+    if (!slot)
         return;
-    }
 
-    auto activeIt = mActiveStreams.find(localId);
-    if (activeIt != mActiveStreams.end()) {
-        auto shared = activeIt->second.lock();
-        if (shared)
-            shared->close();
+    if (slot->pendingOpen) {
+        slot->pendingOpen(std::nullopt);
+        return;
     }
+
+    auto shared = slot->stream.lock();
+    if (shared)
+        shared->close();
 }
 
-void AdbDevice::processWrite(const APacket& packet)
+void AdbDevice::processWrite(APacket& packet)
 {
     assert(packet.getMessage().command == A_WRTE);
     if (!packet.hasPayload())
         return;
 
     const auto& message = packet.getMessage();
-    auto localId = message.arg1;
+    std::shared_ptr<AdbStreamBase> stream;
+    mStreams.read(message.arg1, [&stream](const StreamSlot& slot) {
+        stream = slot.stream.lock();
+    });
 
-    auto it = mActiveStreams.find(localId);
-    if (it != mActiveStreams.end()) {
-        auto stream = it->second.lock();
-        if (stream) {
-            stream->received(packet.getPayload());
-            sendReady(stream->mLocalId, stream->mRemoteId);
-        }
-    }
+    if (stream && stream->received(packet.movePayloadOut()))
+        sendReady(stream->mLocalId, stream->mRemoteId);
 }
 
-void AdbDevice::processAuth(const APacket& packet)
+void AdbDevice::processAuth(APacket& packet)
 {
     assert(packet.getMessage().command == A_AUTH);
     assert(packet.getMessage().arg0 == AuthType::TOKEN);
 
+    if (!isAwaitingConnection()) // timed out or already connected
+        return;
+
     setConnectionState(AUTHORIZING);
 
     if (!packet.hasPayload()) { // empty AUTH, there's an error, stop authorizing
-        setConnectionState(UNAUTHORIZED);
-        mConnected.notify_one();
+        stopConnecting();
         return;
     }
 
-    if (mNextKey >= mPrivateKeyPaths.size()) {
-        if (!sendPublicKey())
-            stopConnecting();
+    std::unique_lock lock(mConnectMutex);
+    auto attempt = mConnectAttempt;
+    lock.unlock();
+
+    // Parsing and signing take milliseconds, keep them off the event thread
+    std::weak_ptr<AdbDevice> weak = weak_from_this();
+    bool posted = KeyStore::shared().post([weak, attempt, token = packet.movePayloadOut()] {
+        if (auto self = weak.lock())
+            self->answerAuth(token, attempt);
+    });
+
+    if (!posted)
+        stopConnecting();
+}
+
+void AdbDevice::answerAuth(const APayload& token, uint64_t attempt)
+{
+    // The attempt may have timed out and a reconnect started meanwhile, this answer belongs to neither
+    std::unique_lock lock(mConnectMutex);
+    if (attempt != mConnectAttempt || !mConnecting || !isAwaitingConnection())
         return;
-    }
 
-    auto signature = signWithPrivateKey(packet.getPayload());
-    if (signature)
+    if (auto signature = signWithPrivateKey(token)) {
         sendAuth(AuthType::SIGNATURE, std::move(*signature));
-    else if (!sendPublicKey())
-        stopConnecting();
+        return;
+    }
+
+    if (auto publicKey = takePublicKey()) {
+        sendAuth(AuthType::RSAPUBLICKEY, std::move(*publicKey));
+        return;
+    }
+
+    lock.unlock();
+    stopConnecting();
 }
 
-void AdbDevice::processTls(const APacket&)
+void AdbDevice::processTls(const APacket& packet)
 {
+    assert(packet.getMessage().command == A_STLS);
+
+    if (!isAwaitingConnection())
+        return;
 
+    // The device authenticates us by the TLS handshake instead of AUTH, CNXN follows inside TLS
+    if (!mTlsConfig) {
+        stopConnecting();
+        return;
+    }
+
+    setConnectionState(AUTHORIZING);
+    sendTls(A_STLS_VERSION, 0); // STLS(version, 0), as adbd sent it
+    if (!startTls(*mTlsConfig))
+        stopConnecting(); // the transport can't do TLS
 }
 
 AdbDevice::~AdbDevice()
@@ -239,66 +390,189 @@ AdbDevice::~AdbDevice()
 
 void AdbDevice::errorListener(int errorCode, const APacket* packet, bool incomingPacket)
 {
-    if (errorCode == Transport::ErrorCode::TRANSPORT_DISCONNECTED)
+    if (errorCode == Transport::ErrorCode::TRANSPORT_DISCONNECTED) {
         setConnectionState(ConnectionState::OFFLINE);
+        finishConnecting();
+        failAllOpens();
+        closeAllStreams();
+    }
 
     if (errorCode != Transport::ErrorCode::OK)
         ;// TODO: Logging
 }
 
-std::optional<AdbDevice::Streams>  AdbDevice::open(const std::string_view& destination)
+std::optional<AdbDevice::Streams> AdbDevice::open(const std::string_view& destination)
 {
-    std::unique_lock lock (mStreamsMutex);
-    auto localId = ++mLastLocalId;
-    auto pairIteratorBool = mAwaitingStreams.emplace(std::piecewise_construct,
-                                                     std::make_tuple(localId),
-                                                     std::make_tuple());
-
-    if (!pairIteratorBool.second)
-        return std::nullopt;
+    return openAsync(destination).get();
+}
 
-    auto& iterator = pairIteratorBool.first;
-    auto& awaitingStruct = iterator->second;
+void AdbDevice::openAsync(const std::string_view& destination, OpenCallback callback)
+{
+    startOpen(destination, StreamSlot{{}, std::move(callback)});
+}
 
-    AdbBase::sendOpen(localId, std::move(APayload(destination)));
+void AdbDevice::openAsync(const std::string_view& destination, AdbStreamBase::Handlers handlers, OpenCallback callback)
+{
+    startOpen(destination, StreamSlot{{}, std::move(callback), std::move(handlers)});
+}
 
-    // Wait for READY or CLOSE packet
-    awaitingStruct.cv.wait(lock);
-    if (awaitingStruct.rejected) {
-        mAwaitingStreams.erase(iterator);
-        return std::nullopt;
+void AdbDevice::startOpen(const std::string_view& destination, StreamSlot&& slot)
+{
+    auto localId = mStreams.insert(std::move(slot));
+    if (localId == SlotTable<StreamSlot>::INVALID_ID) { // too many streams
+        slot.pendingOpen(std::nullopt);
+        return;
     }
 
-    std::shared_ptr<AdbStreamBase> base{new AdbStreamBase{shared_from_this(), localId, awaitingStruct.remoteId}};
-    mActiveStreams[localId] = base;
+    std::weak_ptr<AdbDevice> weak = weak_from_this();
+    AdbBase::sendOpen(localId, APayload(destination), [weak, localId](const APacket*, Transport::ErrorCode code) {
+        if (code == Transport::ErrorCode::OK)
+            return;
+        if (auto self = weak.lock())
+            self->failOpen(localId);
+    });
+}
 
-    mAwaitingStreams.erase(iterator);
-    return Streams{AdbIStream(base),
-                   AdbOStream(base)};
+std::future<std::optional<AdbDevice::Streams>> AdbDevice::openAsync(const std::string_view& destination)
+{
+    auto promise = std::make_shared<std::promise<std::optional<Streams>>>();
+    auto future = promise->get_future();
+    openAsync(destination, [promise](std::optional<Streams> streams) {
+        promise->set_value(std::move(streams));
+    });
+    return future;
+}
+
+std::vector<std::optional<AdbDevice::Streams>> AdbDevice::openMany(const std::vector<std::string>& destinations)
+{
+    std::vector<std::future<std::optional<Streams>>> futures;
+    futures.reserve(destinations.size());
+    for (const auto& destination : destinations)
+        futures.push_back(openAsync(destination));
+
+    std::vector<std::optional<Streams>> result;
+    result.reserve(futures.size());
+    for (auto& future : futures)
+        result.push_back(future.get());
+    return result;
+}
+
+void AdbDevice::failOpen(uint32_t localId)
+{
+    auto slot = mStreams.erase(localId, [](const StreamSlot& slot) {
+        return static_cast<bool>(slot.pendingOpen);
+    });
+
+    if (slot)
+        slot->pendingOpen(std::nullopt);
+}
+
+void AdbDevice::failAllOpens()
+{
+    auto pending = mStreams.eraseIf([](const StreamSlot& slot) {
+        return static_cast<bool>(slot.pendingOpen);
+    });
+
+    for (auto& slot : pending)
+        slot.pendingOpen(std::nullopt);
+}
+
+void AdbDevice::closeAllStreams()
+{
+    // Readers and writers waiting on the streams are released
+    auto slots = mStreams.eraseIf([](const StreamSlot&) { return true; });
+    for (auto& slot : slots)
+        if (auto shared = slot.stream.lock())
+            shared->close();
 }
 
 std::shared_ptr<AdbDevice> AdbDevice::make(AdbDevice::UniqueTransport &&transport) {
     return SharedPointer{new AdbDevice{std::move(transport)}};
 }
 
-void AdbDevice::closeStream(uint32_t localId)
+void AdbDevice::closeStream(uint32_t localId, uint32_t remoteId)
 {
-    auto it = mActiveStreams.find(localId);
-    if (it == mActiveStreams.end())
+    auto slot = mStreams.erase(localId);
+    if (!slot) // closed by the device already
         return;
 
-    auto shared = it->second.lock();
-    if (shared) {
-        sendClose(shared->mLocalId, shared->mRemoteId);
+    sendClose(localId, remoteId);
+
+    auto shared = slot->stream.lock();
+    if (shared)
         shared->close();
+}
+
+void AdbDevice::send(uint32_t localId, uint32_t remoteId, APayload&& payload, SendCompletion completion)
+{
+    sendWrite(localId, remoteId, std::move(payload), std::move(completion));
+}
+
+void AdbDevice::acknowledge(uint32_t localId, uint32_t remoteId)
+{
+    sendReady(localId, remoteId);
+}
+
+void AdbDevice::setOpenHandler(const std::string& destination, OpenHandler handler)
+{
+    std::scoped_lock lock(mOpenHandlersMutex);
+    mOpenHandlers[destination] = std::move(handler);
+}
+
+void AdbDevice::resetOpenHandler(const std::string& destination)
+{
+    std::scoped_lock lock(mOpenHandlersMutex);
+    mOpenHandlers.erase(destination);
+}
+
+AdbDevice::OpenHandler AdbDevice::findOpenHandler(const std::string& destination)
+{
+    std::scoped_lock lock(mOpenHandlersMutex);
+    auto it = mOpenHandlers.find(destination);
+    if (it != mOpenHandlers.end())
+        return it->second;
+
+    auto colon = destination.find(':');
+    if (colon != std::string::npos) {
+        it = mOpenHandlers.find(destination.substr(0, colon + 1));
+        if (it != mOpenHandlers.end())
+            return it->second;
     }
 
-    mActiveStreams.erase(it);
+    it = mOpenHandlers.find("");
+    if (it != mOpenHandlers.end())
+        return it->second;
+    return {};
+}
+
+bool AdbDevice::reverse(const std::string& deviceSpec, const std::string& hostSpec, OpenHandler handler)
+{
+    // The device may connect right after it has replied, handler has to be there already
+    setOpenHandler(hostSpec, std::move(handler));
+    if (requestReverse("reverse:forward:" + deviceSpec + ";" + hostSpec))
+        return true;
+
+    resetOpenHandler(hostSpec);
+    return false;
 }
 
-void AdbDevice::send(uint32_t localId, uint32_t remoteId, APayload&& payload)
+bool AdbDevice::removeReverse(const std::string& deviceSpec, const std::string& hostSpec)
 {
-    sendWrite(localId, remoteId, std::move(payload));
+    bool removed = requestReverse("reverse:killforward:" + deviceSpec);
+    resetOpenHandler(hostSpec);
+    return removed;
+}
+
+bool AdbDevice::requestReverse(const std::string& service)
+{
+    auto streams = open(service);
+    if (!streams)
+        return false;
+
+    // The reply is OKAY, or FAIL with a reason
+    APayload reply{0};
+    streams->istream >> reply;
+    return reply.toStringView().substr(0, 4) == "OKAY";
 }
 
 void AdbDevice::setPrivateKeyPaths(std::vector<std::string> paths)
@@ -321,50 +595,71 @@ std::optional<APayload> AdbDevice::signWithPrivateKey(const APayload& hash)
     APayload signature(256);
     signature.setDataSize(256);
 
-    bool tokenSigned = false;
-    while (!tokenSigned) {
-        mbedtls_pk_context* pk = nullptr;
-        auto id = mNextKey;
-        while (id < mPrivateKeyPaths.size() && !pk) // go through all the keys until we can create pk context
-            pk = utils::crypto::makePkContextFromPem(mPrivateKeyPaths[id++]);
+    // go through the keys until one can be parsed and signs the token
+    while (mNextKey < mKeyOrder.size()) {
+        const auto& path = mKeyOrder[mNextKey++];
+        auto key = KeyStore::shared().getPrivateKey(path);
+        if (!key)
+            continue;
 
-        mNextKey = id + 1;
+        if (key->sign(hash.getBuffer(), hash.getSize(), signature.getBuffer(), signature.getSize())) {
+            mLastSignedKey = path;
+            return signature;
+        }
+    }
 
-        if (pk == nullptr)  // no valid keys found
-            return std::nullopt;
+    return std::nullopt;
+}
 
-        tokenSigned = utils::crypto::sign(pk,
-                                          hash.getBuffer(), hash.getSize(),
-                                          signature.getBuffer(), signature.getSize());
+std::optional<APayload> AdbDevice::takePublicKey()
+{
+    if (mPublicKeyPath.empty() || mPublicIsAlreadyTried)
+        return std::nullopt;
 
-        mbedtls_pk_free(pk);
-    }
+    mPublicIsAlreadyTried = true;
+    mLastSignedKey.clear(); // the user accepts this one, we don't know which private key it matches
+    return KeyStore::shared().getPublicKey(mPublicKeyPath);
+}
+
+void AdbDevice::orderKeys()
+{
+    mKeyOrder = mPrivateKeyPaths;
+    mNextKey = 0;
+    mLastSignedKey.clear();
+
+    const auto& serial = mSerial.empty() ? mSerialHint : mSerial;
+    if (serial.empty())
+        return;
 
-    return signature;
+    auto accepted = KeyStore::shared().getAcceptedKey(serial);
+    if (!accepted)
+        return;
+
+    auto it = std::find(mKeyOrder.begin(), mKeyOrder.end(), *accepted);
+    if (it != mKeyOrder.end())
+        std::rotate(mKeyOrder.begin(), it, it + 1);
 }
 
-bool AdbDevice::sendPublicKey()
+void AdbDevice::setSerialHint(const std::string& serial)
 {
-    if (mPublicKeyPath.empty() || mPublicIsAlreadyTried) {
-        stopConnecting();
-        return false;
-    }
+    mSerialHint = serial;
+}
 
-    std::ifstream fin(mPublicKeyPath);
-    if (!fin.is_open()) {
-        mPublicIsAlreadyTried = true;
-        return false;
-    }
+void AdbDevice::setTlsConfig(const Transport::TlsConfig& config)
+{
+    mTlsConfig = config;
+}
 
-    size_t size = std::filesystem::file_size(mPublicKeyPath);
-    APayload key(size);
-    key.setDataSize(size);
-    fin.read(reinterpret_cast<char*>(key.getBuffer()), size);
-    // TODO: Check I/O exceptions
+void AdbDevice::setStreamWatermarks(AdbStreamBase::Watermarks watermarks)
+{
+    std::scoped_lock lock(mWatermarksMutex);
+    mWatermarks = watermarks;
+}
 
-    sendAuth(AuthType::RSAPUBLICKEY, std::move(key));
-    mPublicIsAlreadyTried = true;
-    return true;
+AdbStreamBase::Watermarks AdbDevice::getStreamWatermarks() const
+{
+    std::scoped_lock lock(mWatermarksMutex);
+    return mWatermarks;
 }
 
 const std::string& AdbDevice::getModel() const
@@ -433,5 +728,5 @@ const FeatureSet& AdbDevice::getFeatures() const
 void AdbDevice::stopConnecting()
 {
     setConnectionState(UNAUTHORIZED);
-    mConnected.notify_one();
+    finishConnecting();
 }
@@ -0,0 +1,314 @@
+#include "AdbServer.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "AdbStreams.hpp"
+#include "TimerQueue.hpp"
+
+
+AdbServer::AdbServer(DeviceManager& manager, int listenFd, ForwardEngine::UniquePointer engine)
+    : mManager(manager)
+    , mListenFd(listenFd)
+    , mRunning(true)
+    , mHandshakes(HANDSHAKE_THREADS)
+    , mEngine(std::move(engine))
+{
+    mAcceptThread = std::thread([this] { acceptClients(); });
+}
+
+AdbServer::UniquePointer AdbServer::make(DeviceManager& manager, const SmartSocket::Endpoint& endpoint)
+{
+    auto engine = ForwardEngine::make();
+    if (!engine) {
+        std::cerr << "[AdbServer] couldn't start the forward engine" << std::endl;
+        return {};
+    }
+
+    int fd = SmartSocket::listen(endpoint);
+    if (fd < 0) {
+        std::cerr << "[AdbServer] couldn't listen on "
+            << (endpoint.unixSocketPath.empty() ? endpoint.host + ":" + std::to_string(endpoint.port)
+                                                : endpoint.unixSocketPath)
+            << std::endl;
+        return {};
+    }
+
+    return UniquePointer{new AdbServer{manager, fd, std::move(engine)}};
+}
+
+AdbServer::~AdbServer()
+{
+    stop();
+    if (mAcceptThread.joinable())
+        mAcceptThread.join();
+
+    // Clients in handshake see their sockets shut down, services go with the engine
+    mHandshakes.stop();
+    std::unique_lock lock(mClientsMutex);
+    mClientsChanged.wait(lock, [this] { return mPendingOpens == 0; }); // within HANDSHAKE_TIMEOUT
+    lock.unlock();
+    mEngine->stop();
+    SmartSocket::close(mListenFd);
+}
+
+void AdbServer::stop()
+{
+    if (!mRunning.exchange(false))
+        return;
+
+    ::shutdown(mListenFd, SHUT_RDWR); // unblocks accept()
+
+    std::unique_lock lock(mClientsMutex);
+    for (int fd : mClients)
+        ::shutdown(fd, SHUT_RDWR);
+    lock.unlock();
+    mClientsChanged.notify_all();
+
+    mEngine->stop();
+}
+
+void AdbServer::wait()
+{
+    std::unique_lock lock(mClientsMutex);
+    mClientsChanged.wait(lock, [this] { return !mRunning; });
+}
+
+bool AdbServer::isRunning() const
+{
+    return mRunning;
+}
+
+void AdbServer::acceptClients()
+{
+    while (mRunning) {
+        int fd = ::accept4(mListenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (!mRunning)
+                break;
+            if (errno == EINTR || errno == ECONNABORTED || errno == EPROTO)
+                continue;
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                // Retrying right away would spin until some client goes away
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+            std::cerr << "[AdbServer] accept failed, errno: " << errno << std::endl;
+            break; // EBADF, EINVAL: the listening socket is gone
+        }
+
+        // A client that never sends its request gives its handshake thread back after the timeout
+        timeval timeout{};
+        timeout.tv_sec = HANDSHAKE_TIMEOUT.count();
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        std::unique_lock lock(mClientsMutex);
+        if (!mRunning) {
+            SmartSocket::close(fd);
+            break;
+        }
+        mClients.insert(fd);
+        lock.unlock();
+
+        bool posted = mHandshakes.post([this, fd] {
+            if (serveClient(fd))
+                return;
+
+            std::scoped_lock lock(mClientsMutex);
+            mClients.erase(fd);
+            SmartSocket::close(fd);
+        });
+
+        if (!posted) {
+            lock.lock();
+            mClients.erase(fd);
+            SmartSocket::close(fd);
+        }
+    }
+}
+
+bool AdbServer::serveClient(int fd)
+{
+    AdbDevice::SharedPointer selected;
+
+    while (mRunning) {
+        auto request = SmartSocket::readRequest(fd);
+        if (!request)
+            return false;
+
+        bool isHostRequest = request->rfind("host", 0) == 0;
+        if (isHostRequest) {
+            if (!serveHostRequest(fd, *request, selected))
+                return false; // the request finished the connection
+            continue;         // host:transport switched the connection, the service follows
+        }
+
+        if (!selected)
+            selected = selectDevice({});
+        if (!selected) {
+            SmartSocket::writeFail(fd, "no devices/emulators found");
+            return false;
+        }
+
+        return serveService(fd, selected, *request);
+    }
+    return false;
+}
+
+bool AdbServer::serveHostRequest(int fd, const std::string& request, AdbDevice::SharedPointer& selected)
+{
+    // host-serial:<serial>:<query> is host:<query> for a chosen device
+    std::string query = request;
+    AdbDevice::SharedPointer device = selected;
+    if (request.rfind("host-serial:", 0) == 0) {
+        auto rest = request.substr(12);
+        auto colon = rest.rfind(':');
+        if (colon == std::string::npos) {
+            SmartSocket::writeFail(fd, "invalid request");
+            return false;
+        }
+        device = selectDevice(rest.substr(0, colon));
+        query = "host:" + rest.substr(colon + 1);
+        if (!device) {
+            SmartSocket::writeFail(fd, "device '" + rest.substr(0, colon) + "' not found");
+            return false;
+        }
+    }
+
+    if (query == "host:version") {
+        char version[5];
+        std::snprintf(version, sizeof(version), "%04x", VERSION);
+        SmartSocket::writeOkay(fd, version);
+        return false;
+    }
+
+    if (query == "host:devices" || query == "host:devices-l") {
+        SmartSocket::writeOkay(fd, formatDevices(query == "host:devices-l"));
+        return false;
+    }
+
+    if (query == "host:kill") {
+        SmartSocket::writeOkay(fd);
+        stop();
+        return false;
+    }
+
+    if (query.rfind("host:transport", 0) == 0) {
+        if (query == "host:transport-any" || query == "host:transport-usb")
+            device = selectDevice({});
+        else if (query.rfind("host:transport:", 0) == 0)
+            device = selectDevice(query.substr(15));
+        else {
+            SmartSocket::writeFail(fd, "unsupported transport request");
+            return false;
+        }
+
+        if (!device) {
+            SmartSocket::writeFail(fd, "device not found");
+            return false;
+        }
+
+        selected = device;
+        SmartSocket::writeOkay(fd);
+        return true;
+    }
+
+    // Queries about one device
+    if (!device)
+        device = selectDevice({});
+    if (!device) {
+        SmartSocket::writeFail(fd, "no devices/emulators found");
+        return false;
+    }
+
+    if (query == "host:features")
+        SmartSocket::writeOkay(fd, Features::setToString(device->getFeatures()));
+    else if (query == "host:get-state")
+        SmartSocket::writeOkay(fd, device->getSystemType());
+    else if (query == "host:get-serialno")
+        SmartSocket::writeOkay(fd, device->getSerial());
+    else
+        SmartSocket::writeFail(fd, "unsupported request: " + request);
+    return false;
+}
+
+bool AdbServer::serveService(int fd, const AdbDevice::SharedPointer& device, const std::string& service)
+{
+    // The handshake thread moves on, the client is answered by the open's callback or by the deadline,
+    // whichever comes first. The loser touches nothing but the flag
+    auto answered = std::make_shared<std::atomic<bool>>(false);
+    std::unique_lock lock(mClientsMutex);
+    ++mPendingOpens;
+    lock.unlock();
+
+    auto timer = TimerQueue::shared().schedule(HANDSHAKE_TIMEOUT, [this, fd, answered] {
+        if (!answered->exchange(true))
+            finishService(fd, nullptr, std::nullopt);
+    });
+
+    device->openAsync(service, [this, fd, device, answered, timer](std::optional<AdbDevice::Streams> streams) {
+        if (answered->exchange(true))
+            return; // timed out, dropping the streams closes them
+        TimerQueue::shared().cancel(timer);
+        finishService(fd, device, std::move(streams));
+    });
+    return true;
+}
+
+void AdbServer::finishService(int fd,
+                              const AdbDevice::SharedPointer& device,
+                              std::optional<AdbDevice::Streams> streams)
+{
+    // On the transport's event thread or the timer thread: the status fits into the idle socket's buffer
+    if (streams)
+        SmartSocket::writeOkay(fd);
+    else
+        SmartSocket::writeFail(fd, "closed");
+
+    // The fd is the engine's from now on, stop() reaches it through the engine
+    std::unique_lock lock(mClientsMutex);
+    mClients.erase(fd);
+    lock.unlock();
+
+    if (streams)
+        mEngine->adopt(device, std::move(*streams), fd); // closes the fd if the engine is stopped
+    else
+        SmartSocket::close(fd);
+
+    lock.lock();
+    --mPendingOpens;
+    mClientsChanged.notify_all(); // under the lock, the destructor may be waiting for this
+}
+
+AdbDevice::SharedPointer AdbServer::selectDevice(const std::string& serial) const
+{
+    if (!serial.empty())
+        return mManager.find(serial);
+
+    auto devices = mManager.getDevices();
+    if (devices.size() != 1)
+        return {}; // "any" is ambiguous with several devices, as in adb
+    return devices.front();
+}
+
+std::string AdbServer::formatDevices(bool longFormat) const
+{
+    std::string result;
+    for (const auto& device : mManager.getDevices()) {
+        result += device->getSerial();
+        if (longFormat) {
+            result += "            " + device->getSystemType();
+            result += " product:" + device->getProduct();
+            result += " model:" + device->getModel();
+            result += " device:" + device->getDevice();
+        }
+        else
+            result += "\t" + device->getSystemType();
+        result += '\n';
+    }
+    return result;
+}
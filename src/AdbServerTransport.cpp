@@ -0,0 +1,479 @@
+#include "AdbServerTransport.hpp"
+
+#include <cerrno>
+#include <iostream>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Features.hpp"
+
+
+static APacket makePacket(uint32_t command, uint32_t arg0, uint32_t arg1)
+{
+    return APacket(AMessage::make(command, arg0, arg1));
+}
+
+static APacket makePacket(uint32_t command, uint32_t arg0, uint32_t arg1, APayload&& payload)
+{
+    APacket packet(AMessage::make(command, arg0, arg1), std::move(payload));
+    packet.updateMessageDataLength();
+    packet.computeChecksum();
+    return packet;
+}
+
+AdbServerTransport::Connection::Connection(int fd, uint32_t localId)
+    : fd(fd)
+    , localId(localId)
+    , hostReady(true)
+{}
+
+AdbServerTransport::Connection::~Connection()
+{
+    SmartSocket::close(fd);
+}
+
+AdbServerTransport::AdbServerTransport(std::string serial, const Config& config)
+    : mSerial(std::move(serial))
+    , mConfig(config)
+    , mRunning(true)
+    , mWorkers(config.workerCount)
+{
+    mMaxPayloadSize = MAX_FRAMEWORK_PAYLOAD;
+
+    if (!SmartSocket::openPipe(mWakePipe)) {
+        mRunning = false;
+        return;
+    }
+
+    mThread = std::thread([this] { run(); });
+}
+
+AdbServerTransport::~AdbServerTransport()
+{
+    mWorkers.stop();
+
+    mRunning = false;
+    wake();
+    if (mThread.joinable())
+        mThread.join();
+
+    std::unordered_map<uint32_t, SharedConnection> connections;
+    {
+        std::scoped_lock lock(mPoolMutex, mConnectionsMutex);
+        for (int fd : mPool)
+            SmartSocket::close(fd);
+        connections.swap(mConnections);
+    }
+
+    for (auto& [remoteId, connection] : connections) {
+        for (auto& entry : connection->outgoing)
+            complete(entry.packet, entry.completion, CANCELLED);
+    }
+    connections.clear();
+
+    SmartSocket::close(mWakePipe[0]);
+    SmartSocket::close(mWakePipe[1]);
+}
+
+std::unique_ptr<AdbServerTransport> AdbServerTransport::make(const std::string& serial)
+{
+    return make(serial, Config{SmartSocket::Endpoint::local(), 4, 4});
+}
+
+std::unique_ptr<AdbServerTransport> AdbServerTransport::make(const std::string& serial, const Config& config)
+{
+    std::unique_ptr<AdbServerTransport> transport{new AdbServerTransport{serial, config}};
+    if (!transport->mRunning)
+        return {};
+    return transport;
+}
+
+std::vector<SmartSocket::DeviceInfo> AdbServerTransport::listDevices(const SmartSocket::Endpoint& endpoint)
+{
+    auto reply = SmartSocket::query(endpoint, "host:devices-l");
+    if (!reply)
+        return {};
+    return SmartSocket::parseDevices(*reply);
+}
+
+const std::string& AdbServerTransport::getSerial() const
+{
+    return mSerial;
+}
+
+void AdbServerTransport::send(APacket&& packet, Completion completion)
+{
+    const auto& message = packet.getMessage();
+    if (message.command == A_WRTE) {
+        write(std::move(packet), std::move(completion)); // completed once the server has the payload
+        return;
+    }
+
+    std::unique_lock lock(mIncomingMutex);
+    auto errorCode = mDisconnected ? TRANSPORT_DISCONNECTED : OK;
+    lock.unlock();
+
+    switch (message.command) {
+        case A_CNXN:
+            mWorkers.post([this] { connectToDevice(); });
+            break;
+        case A_OPEN: {
+            auto destination = packet.hasPayload() ? packet.getPayload().toString() : std::string{};
+            if (!destination.empty() && destination.back() == '\0')
+                destination.pop_back();
+            mWorkers.post([this, localId = message.arg0, destination = std::move(destination)] {
+                openStream(localId, destination);
+            });
+            break;
+        }
+        case A_OKAY:
+            hostReady(message.arg1);
+            break;
+        case A_CLSE:
+            closeStream(message.arg1, false);
+            break;
+        default:
+            break; // AUTH and STLS are the server's business
+    }
+
+    complete(packet, completion, errorCode);
+}
+
+void AdbServerTransport::receive()
+{
+    std::unique_lock lock(mIncomingMutex);
+    mReceiveRequested = true;
+    bool pending = !mIncoming.empty() || (mDisconnected && !mDisconnectReported);
+    lock.unlock();
+
+    if (pending && mThread.get_id() != std::this_thread::get_id())
+        wake();
+}
+
+void AdbServerTransport::connectToDevice()
+{
+    std::string state = "device";
+    std::string properties;
+
+    for (const auto& info : listDevices(mConfig.endpoint)) {
+        if (info.serial != mSerial)
+            continue;
+
+        state = info.state;
+        for (const auto& [key, property] : {std::pair{"product", "ro.product.name"},
+                                            std::pair{"model", "ro.product.model"},
+                                            std::pair{"device", "ro.product.device"}}) {
+            auto it = info.properties.find(key);
+            if (it != info.properties.end())
+                properties += std::string(property) + "=" + it->second + ";";
+        }
+    }
+
+    auto features = SmartSocket::query(mConfig.endpoint, "host-serial:" + mSerial + ":features");
+    if (!features) {
+        std::cerr << "[AdbServerTransport] device " << mSerial << " isn't available through the server" << std::endl;
+        disconnect();
+        return;
+    }
+
+    properties += "features=" + *features;
+    auto banner = state + ":" + mSerial + ":" + properties;
+    APayload payload(banner.size());
+    payload.setDataSize(banner.size());
+    std::copy(banner.begin(), banner.end(), payload.begin());
+
+    refillPool();
+    enqueue(makePacket(A_CNXN, A_VERSION, mMaxPayloadSize, std::move(payload)));
+}
+
+int AdbServerTransport::takePooledConnection()
+{
+    std::unique_lock lock(mPoolMutex);
+    if (!mPool.empty()) {
+        int fd = mPool.back();
+        mPool.pop_back();
+        lock.unlock();
+
+        mWorkers.post([this] { refillPool(); });
+        return fd;
+    }
+    lock.unlock();
+
+    mWorkers.post([this] { refillPool(); });
+    return SmartSocket::request(mConfig.endpoint, "host:transport:" + mSerial);
+}
+
+void AdbServerTransport::refillPool()
+{
+    std::unique_lock lock(mPoolMutex);
+    if (mRefilling)
+        return;
+    mRefilling = true;
+
+    while (mRunning && mPool.size() < mConfig.poolSize) {
+        lock.unlock();
+        int fd = SmartSocket::request(mConfig.endpoint, "host:transport:" + mSerial);
+        lock.lock();
+
+        if (fd < 0)
+            break;
+        mPool.push_back(fd);
+    }
+
+    mRefilling = false;
+}
+
+void AdbServerTransport::openStream(uint32_t localId, std::string destination)
+{
+    int fd = takePooledConnection();
+    std::string failMessage;
+    if (fd < 0 || !SmartSocket::sendRequest(fd, destination) || !SmartSocket::readStatus(fd, &failMessage)
+            || !SmartSocket::setNonBlocking(fd)) {
+        if (!failMessage.empty())
+            std::cerr << "[AdbServerTransport] " << destination << ": " << failMessage << std::endl;
+        SmartSocket::close(fd);
+        enqueue(makePacket(A_CLSE, 0, localId));
+        return;
+    }
+
+    std::unique_lock lock(mConnectionsMutex);
+    auto remoteId = ++mLastRemoteId;
+    mConnections.emplace(remoteId, std::make_shared<Connection>(fd, localId));
+    lock.unlock();
+
+    enqueue(makePacket(A_OKAY, remoteId, localId));
+}
+
+void AdbServerTransport::write(APacket&& packet, Completion completion)
+{
+    auto remoteId = packet.getMessage().arg1;
+
+    std::unique_lock lock(mConnectionsMutex);
+    auto it = mConnections.find(remoteId);
+    auto connection = it != mConnections.end() ? it->second : nullptr;
+    lock.unlock();
+
+    bool queued = false;
+    if (connection) {
+        std::scoped_lock outgoingLock(connection->outgoingMutex);
+        if (!connection->closed) {
+            connection->outgoing.push_back({std::move(packet), std::move(completion), 0});
+            queued = true;
+        }
+    }
+
+    if (!queued) {
+        complete(packet, completion, UNDERLYING_ERROR); // the stream is closed or was never opened
+        return;
+    }
+
+    if (mThread.get_id() != std::this_thread::get_id()) // the I/O thread polls for POLLOUT before it sleeps
+        wake();
+}
+
+void AdbServerTransport::hostReady(uint32_t remoteId)
+{
+    std::unique_lock lock(mConnectionsMutex);
+    auto it = mConnections.find(remoteId);
+    if (it == mConnections.end())
+        return;
+
+    it->second->hostReady = true;
+    lock.unlock();
+    wake(); // start polling the socket again
+}
+
+void AdbServerTransport::closeStream(uint32_t remoteId, bool notifyHost)
+{
+    std::unique_lock lock(mConnectionsMutex);
+    auto it = mConnections.find(remoteId);
+    if (it == mConnections.end())
+        return;
+
+    auto connection = std::move(it->second);
+    mConnections.erase(it);
+    lock.unlock();
+
+    std::unique_lock outgoingLock(connection->outgoingMutex);
+    connection->closed = true;
+    auto outgoing = std::move(connection->outgoing);
+    outgoingLock.unlock();
+
+    // fd is closed with the last reference, the I/O thread may still be polling it
+    ::shutdown(connection->fd, SHUT_RDWR);
+    if (notifyHost)
+        enqueue(makePacket(A_CLSE, remoteId, connection->localId));
+    wake();
+
+    for (auto& entry : outgoing)
+        complete(entry.packet, entry.completion, CANCELLED);
+}
+
+void AdbServerTransport::complete(APacket& packet, const Completion& completion, ErrorCode errorCode)
+{
+    if (completion)
+        completion(&packet, errorCode);
+    notifySendListener(&packet, errorCode);
+}
+
+void AdbServerTransport::enqueue(APacket&& packet)
+{
+    std::unique_lock lock(mIncomingMutex);
+    mIncoming.push_back(std::move(packet));
+    lock.unlock();
+
+    if (mThread.get_id() != std::this_thread::get_id())
+        wake();
+}
+
+void AdbServerTransport::wake()
+{
+    char byte = 0;
+    [[maybe_unused]] auto res = ::write(mWakePipe[1], &byte, 1); // full pipe means a wake-up is pending anyway
+}
+
+void AdbServerTransport::run()
+{
+    std::vector<pollfd> pollFds;
+    std::vector<std::pair<uint32_t, SharedConnection>> polled;
+
+    while (mRunning) {
+        pollFds.clear();
+        polled.clear();
+        pollFds.push_back({mWakePipe[0], POLLIN, 0});
+
+        {
+            std::scoped_lock lock(mConnectionsMutex);
+            for (const auto& [remoteId, connection] : mConnections) {
+                // flow control: the socket isn't read until the host acknowledges the previous WRTE
+                short events = connection->hostReady ? POLLIN : 0;
+                std::unique_lock outgoingLock(connection->outgoingMutex);
+                if (!connection->outgoing.empty())
+                    events |= POLLOUT;
+                outgoingLock.unlock();
+
+                if (events == 0)
+                    continue;
+                pollFds.push_back({connection->fd, events, 0});
+                polled.emplace_back(remoteId, connection);
+            }
+        }
+
+        int res = ::poll(pollFds.data(), pollFds.size(), -1);
+        if (res < 0 && errno != EINTR)
+            break;
+
+        if (pollFds[0].revents & POLLIN) {
+            char buffer[256];
+            while (::read(mWakePipe[0], buffer, sizeof(buffer)) > 0)
+                ;
+        }
+
+        for (size_t i = 1; i < pollFds.size(); ++i) {
+            const auto& [remoteId, connection] = polled[i - 1];
+            if ((pollFds[i].events & POLLOUT) && (pollFds[i].revents & (POLLOUT | POLLHUP | POLLERR)))
+                flush(remoteId, connection);
+            if ((pollFds[i].events & POLLIN) && (pollFds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                readFrom(remoteId, connection);
+        }
+
+        deliver();
+    }
+}
+
+void AdbServerTransport::readFrom(uint32_t remoteId, const SharedConnection& connection)
+{
+    APayload payload(mMaxPayloadSize);
+    auto received = ::recv(connection->fd, payload.getBuffer(), payload.getBufferSize(), 0);
+    if (received < 0 && (errno == EINTR || errno == EAGAIN))
+        return;
+
+    if (received <= 0) {
+        closeStream(remoteId, true);
+        return;
+    }
+
+    payload.setDataSize(received);
+    connection->hostReady = false;
+    enqueue(makePacket(A_WRTE, remoteId, connection->localId, std::move(payload)));
+}
+
+void AdbServerTransport::flush(uint32_t remoteId, const SharedConnection& connection)
+{
+    std::deque<Outgoing> written;
+    std::deque<Outgoing> failed;
+
+    std::unique_lock lock(connection->outgoingMutex);
+    auto& outgoing = connection->outgoing;
+    while (!outgoing.empty()) {
+        auto& entry = outgoing.front();
+        auto size = entry.packet.hasPayload() ? entry.packet.getPayload().getSize() : 0;
+        if (entry.written < size) {
+            const auto* data = entry.packet.getPayload().getBuffer() + entry.written;
+            auto sent = ::send(connection->fd, data, size - entry.written, SmartSocket::NO_SIGNAL);
+            if (sent < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+                break; // the next POLLOUT continues
+            if (sent <= 0) {
+                failed.swap(outgoing);
+                break;
+            }
+
+            entry.written += sent;
+            continue;
+        }
+
+        written.push_back(std::move(entry));
+        outgoing.pop_front();
+    }
+    lock.unlock();
+
+    // The host may send the next WRTE once the server took this one
+    for (auto& entry : written) {
+        enqueue(makePacket(A_OKAY, remoteId, connection->localId));
+        complete(entry.packet, entry.completion, OK);
+    }
+
+    if (!failed.empty()) {
+        closeStream(remoteId, true);
+        for (auto& entry : failed)
+            complete(entry.packet, entry.completion, UNDERLYING_ERROR);
+    }
+}
+
+void AdbServerTransport::deliver()
+{
+    std::unique_lock lock(mIncomingMutex);
+    while (mReceiveRequested) {
+        if (!mIncoming.empty()) {
+            auto packet = std::move(mIncoming.front());
+            mIncoming.pop_front();
+            mReceiveRequested = false; // listener re-arms with receive()
+            lock.unlock();
+
+            notifyReceiveListener(&packet, OK);
+        }
+        else if (mDisconnected && !mDisconnectReported) {
+            mDisconnectReported = true;
+            mReceiveRequested = false;
+            lock.unlock();
+
+            APacket packet;
+            notifyReceiveListener(&packet, TRANSPORT_DISCONNECTED);
+        }
+        else {
+            break;
+        }
+
+        lock.lock();
+    }
+}
+
+void AdbServerTransport::disconnect()
+{
+    std::unique_lock lock(mIncomingMutex);
+    mDisconnected = true;
+    lock.unlock();
+    wake(); // reported by the I/O thread once the listener asks for a packet
+}
@@ -0,0 +1,408 @@
+#include "DeviceManager.hpp"
+
+#include <iostream>
+
+#include "TimerQueue.hpp"
+
+
+DeviceManager::DeviceManager(std::vector<SharedContext> contexts, Config config)
+    : mConfig(std::move(config))
+    , mWorkers(mConfig.workerCount)
+{
+    for (size_t i = 0; i < contexts.size(); ++i)
+        mShards.push_back(std::make_unique<Shard>(Shard{this, std::move(contexts[i]), i, false, {}}));
+}
+
+DeviceManager::UniquePointer DeviceManager::make(SharedContext context)
+{
+    return make(std::move(context), Config{});
+}
+
+DeviceManager::UniquePointer DeviceManager::make(SharedContext context, Config config)
+{
+    if (!context)
+        return {};
+
+    return UniquePointer{new DeviceManager{{std::move(context)}, std::move(config)}};
+}
+
+DeviceManager::UniquePointer DeviceManager::make(UsbEventLoopPool::SharedPointer loops, Config config)
+{
+    if (!loops)
+        return {};
+
+    std::vector<SharedContext> contexts;
+    for (size_t i = 0; i < loops->getLoopCount(); ++i)
+        contexts.push_back(loops->getLoop(i).getContext());
+
+    UniquePointer manager{new DeviceManager{std::move(contexts), std::move(config)}};
+    manager->mLoops = std::move(loops);
+    return manager;
+}
+
+DeviceManager::~DeviceManager()
+{
+    stop();
+}
+
+bool DeviceManager::start()
+{
+    if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+        // No hotplug on this platform, attach whatever is connected right now.
+        // Keys and shards are picked as in the hotplug path, so they stay stable between enumerations
+        for (auto& shard : mShards) {
+            libusb_device** devices = nullptr;
+            ssize_t count = libusb_get_device_list(shard->context->getRawContext(), &devices);
+            for (ssize_t i = 0; i < count; ++i) {
+                auto key = makeLocationKey(devices[i]);
+                if (std::hash<LocationKey>{}(key) % mShards.size() == shard->index)
+                    arrived(key, devices[i]);
+            }
+            if (count >= 0)
+                libusb_free_device_list(devices, 1);
+        }
+        return false;
+    }
+
+    // Every context sees every device, a shard picks up only the devices hashed to it
+    bool ok = true;
+    for (auto& shard : mShards) {
+        if (shard->hotplugRegistered)
+            continue;
+
+        int res = libusb_hotplug_register_callback(shard->context->getRawContext(),
+                                                   LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+                                                   LIBUSB_HOTPLUG_ENUMERATE,
+                                                   LIBUSB_HOTPLUG_MATCH_ANY,
+                                                   LIBUSB_HOTPLUG_MATCH_ANY,
+                                                   LIBUSB_HOTPLUG_MATCH_ANY,
+                                                   staticHotplugCallback,
+                                                   shard.get(),
+                                                   &shard->hotplugHandle);
+        if (res != LIBUSB_SUCCESS) {
+            std::cerr << "[DeviceManager] hotplug callback wasn't registered, libusb_error: "
+                << libusb_error_name(res) << std::endl;
+            ok = false;
+            continue;
+        }
+
+        shard->hotplugRegistered = true;
+    }
+
+    return ok;
+}
+
+void DeviceManager::stop()
+{
+    for (auto& shard : mShards) {
+        if (!shard->hotplugRegistered)
+            continue;
+
+        libusb_hotplug_deregister_callback(shard->context->getRawContext(), shard->hotplugHandle);
+        shard->hotplugRegistered = false;
+    }
+
+    mWorkers.stop();
+
+    // Handshakes in flight and retries hold a pointer to the manager, they finish within connectTimeout
+    std::unique_lock lock(mDevicesMutex);
+    mDeviceAdded.wait(lock, [this] { return mPending.empty(); });
+}
+
+int DeviceManager::staticHotplugCallback(libusb_context*,
+                                         libusb_device* device,
+                                         libusb_hotplug_event event,
+                                         void* userData)
+{
+    // Nothing blocking here: AdbDevice's handshake needs this very thread to receive packets
+    UsbEventLoop::BusyScope busy;
+    auto* shard = static_cast<Shard*>(userData);
+    auto* manager = shard->manager;
+    auto key = makeLocationKey(device);
+
+    if (std::hash<LocationKey>{}(key) % manager->mShards.size() != shard->index)
+        return 0; // device belongs to another shard
+
+    if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED) {
+        manager->arrived(key, device);
+    }
+    else if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT) {
+        manager->mWorkers.post([manager, key] {
+            manager->detach(key);
+        });
+    }
+
+    return 0; // keep the callback registered
+}
+
+DeviceManager::LocationKey DeviceManager::makeLocationKey(libusb_device* device)
+{
+    libusb_device_descriptor descriptor{};
+    libusb_get_device_descriptor(device, &descriptor); // cached by libusb, no I/O
+
+    uint8_t ports[8];
+    int portCount = libusb_get_port_numbers(device, ports, sizeof(ports));
+
+    LocationKey key = std::to_string(libusb_get_bus_number(device));
+    for (int i = 0; i < portCount; ++i)
+        key += (i == 0 ? '-' : '.') + std::to_string(ports[i]);
+
+    // A device switching modes changes its product id and has to be looked up again
+    key += ':' + std::to_string(descriptor.idVendor) + ':' + std::to_string(descriptor.idProduct);
+    return key;
+}
+
+std::string DeviceManager::readSerialNumber(libusb_device* device)
+{
+    libusb_device_descriptor descriptor{};
+    if (libusb_get_device_descriptor(device, &descriptor) != LIBUSB_SUCCESS || descriptor.iSerialNumber == 0)
+        return {};
+
+    libusb_device_handle* handle = nullptr;
+    if (libusb_open(device, &handle) != LIBUSB_SUCCESS)
+        return {};
+
+    unsigned char buffer[256];
+    int length = libusb_get_string_descriptor_ascii(handle, descriptor.iSerialNumber, buffer, sizeof(buffer));
+    libusb_close(handle);
+
+    if (length <= 0)
+        return {};
+    return std::string(reinterpret_cast<const char*>(buffer), length);
+}
+
+std::optional<InterfaceData> DeviceManager::lookupInterface(const LocationKey& key,
+                                                            const UsbTransport::Device& device)
+{
+    {
+        std::scoped_lock lock(mCacheMutex);
+        auto it = mInterfaceCache.find(key);
+        if (it != mInterfaceCache.end())
+            return it->second;
+    }
+
+    auto interface = UsbTransport::findAdbInterface(device);
+
+    std::scoped_lock lock(mCacheMutex);
+    mInterfaceCache[key] = interface;
+    return interface;
+}
+
+void DeviceManager::arrived(const LocationKey& key, libusb_device* device)
+{
+    libusb_ref_device(device); // released by the worker
+    bool posted = mWorkers.post([this, key, device] {
+        // Reading the serial number is a control transfer, it doesn't belong on the event thread
+        Arrival arrival{UsbTransport::Device(device), mConfig.autoConnect ? std::string{} : readSerialNumber(device)};
+        libusb_unref_device(device); // the wrapper holds its own reference now
+        attach(key, arrival);
+    });
+    if (!posted)
+        libusb_unref_device(device);
+}
+
+void DeviceManager::attach(const LocationKey& key, const Arrival& arrival)
+{
+    {
+        std::scoped_lock lock(mDevicesMutex);
+        if (mPending.count(key) != 0) {
+            // Being attached: a device that went away and came back is attached once the old one is dropped
+            auto detached = mDetached.find(key);
+            if (detached != mDetached.end())
+                detached->second.emplace(arrival);
+            return;
+        }
+        if (mSerials.count(key) != 0)
+            return; // already attached
+        mPending.insert(key);
+    }
+
+    const auto& device = arrival.device;
+    AdbDevice::SharedPointer adbDevice;
+    auto interface = lookupInterface(key, device);
+    if (interface) {
+        auto transport = UsbTransport::make(device, *interface);
+        if (transport) {
+            adbDevice = AdbDevice::make(std::move(transport));
+            adbDevice->setPrivateKeyPaths(mConfig.privateKeyPaths);
+            adbDevice->setPublicKeyPath(mConfig.publicKeyPath);
+
+            std::scoped_lock lock(mDevicesMutex);
+            auto hint = mLastSerials.find(key);
+            if (hint != mLastSerials.end())
+                adbDevice->setSerialHint(hint->second);
+            else if (!arrival.serialNumber.empty())
+                adbDevice->setSerialHint(arrival.serialNumber);
+        }
+        else {
+            // The interface may be busy or the device was reconfigured, look it up next time
+            std::scoped_lock lock(mCacheMutex);
+            mInterfaceCache.erase(key);
+        }
+    }
+
+    if (!adbDevice) {
+        abandon(key);
+        return;
+    }
+
+    if (!mConfig.autoConnect)
+        publish(key, adbDevice, arrival.serialNumber);
+    else
+        connect(key, adbDevice);
+}
+
+void DeviceManager::connect(const LocationKey& key, const AdbDevice::SharedPointer& device)
+{
+    // The handshake runs on the event loop, the worker is free to bring up the next device
+    device->connectAsync(mConfig.connectTimeout, [this, key, device](AdbDevice::ConnectionState) {
+        auto task = [this, key, device] { publish(key, device, {}); };
+        if (!mWorkers.post(task))
+            task(); // stopping, stop() waits for this
+    });
+}
+
+void DeviceManager::retryConnect(const LocationKey& key, const AdbDevice::SharedPointer& device)
+{
+    // The key stays pending meanwhile, stop() waits for the timer
+    TimerQueue::shared().schedule(CONNECT_RETRY_DELAY, [this, key, device] {
+        if (!mWorkers.post([this, key, device] { connect(key, device); }))
+            abandon(key);
+    });
+}
+
+void DeviceManager::publish(const LocationKey& key,
+                            const AdbDevice::SharedPointer& device,
+                            const std::string& serialNumber)
+{
+    std::unique_lock lock(mDevicesMutex);
+    auto detached = mDetached.find(key);
+    if (detached != mDetached.end()) {
+        // Went away during the handshake, the device that came back meanwhile starts over
+        auto arrival = std::move(detached->second);
+        mDetached.erase(detached);
+        mPending.erase(key);
+        lock.unlock();
+        mDeviceAdded.notify_all(); // stop() waits for pending devices
+
+        if (arrival)
+            mWorkers.post([this, key, arrival = std::move(*arrival)] { attach(key, arrival); });
+        return;
+    }
+
+    if (mConfig.autoConnect && !device->isConnected()) {
+        // Timed out or UNAUTHORIZED, e.g. the user hasn't allowed the key yet. Tried again until it goes away
+        lock.unlock();
+        retryConnect(key, device);
+        return;
+    }
+    mPending.erase(key);
+
+    // Serial is known after CNXN only, unconnected devices go by their USB serial number, or location without one
+    const auto& serial = mConfig.autoConnect ? device->getSerial() : (serialNumber.empty() ? key : serialNumber);
+    mSerials[key] = serial;
+    mDevices[serial] = device;
+    if (mConfig.autoConnect)
+        mLastSerials[key] = serial;
+    auto listener = mAttachListener;
+    lock.unlock();
+    mDeviceAdded.notify_all();
+
+    if (listener)
+        listener(device);
+}
+
+void DeviceManager::abandon(const LocationKey& key)
+{
+    std::unique_lock lock(mDevicesMutex);
+    mPending.erase(key);
+    mDetached.erase(key);
+    lock.unlock();
+    mDeviceAdded.notify_all(); // stop() waits for pending devices
+}
+
+void DeviceManager::detach(const LocationKey& key)
+{
+    std::unique_lock lock(mDevicesMutex);
+    if (mPending.count(key) != 0) {
+        mDetached[key] = std::nullopt; // publish() drops the device
+        return;
+    }
+
+    auto serialIt = mSerials.find(key);
+    if (serialIt == mSerials.end())
+        return;
+
+    auto deviceIt = mDevices.find(serialIt->second);
+    AdbDevice::SharedPointer device;
+    if (deviceIt != mDevices.end()) {
+        device = std::move(deviceIt->second);
+        mDevices.erase(deviceIt);
+    }
+    mSerials.erase(serialIt);
+    auto listener = mDetachListener;
+    lock.unlock();
+
+    if (device && listener)
+        listener(device);
+}
+
+AdbDevice::SharedPointer DeviceManager::find(const std::string& serial) const
+{
+    std::scoped_lock lock(mDevicesMutex);
+    auto it = mDevices.find(serial);
+    if (it == mDevices.end())
+        return {};
+    return it->second;
+}
+
+std::vector<AdbDevice::SharedPointer> DeviceManager::getDevices() const
+{
+    std::scoped_lock lock(mDevicesMutex);
+    std::vector<AdbDevice::SharedPointer> devices;
+    devices.reserve(mDevices.size());
+    for (const auto& [serial, device] : mDevices)
+        devices.push_back(device);
+    return devices;
+}
+
+size_t DeviceManager::getDeviceCount() const
+{
+    std::scoped_lock lock(mDevicesMutex);
+    return mDevices.size();
+}
+
+AdbDevice::SharedPointer DeviceManager::waitForDevice(const std::string& serial, std::chrono::milliseconds timeout)
+{
+    std::unique_lock lock(mDevicesMutex);
+    AdbDevice::SharedPointer result;
+    mDeviceAdded.wait_for(lock, timeout, [&] {
+        auto it = mDevices.find(serial);
+        if (it == mDevices.end())
+            return false;
+        result = it->second;
+        return true;
+    });
+    return result;
+}
+
+AdbDevice::SharedPointer DeviceManager::waitForAny(std::chrono::milliseconds timeout)
+{
+    std::unique_lock lock(mDevicesMutex);
+    mDeviceAdded.wait_for(lock, timeout, [this] { return !mDevices.empty(); });
+    if (mDevices.empty())
+        return {};
+    return mDevices.begin()->second;
+}
+
+void DeviceManager::setAttachListener(DeviceManager::DeviceListener listener)
+{
+    std::scoped_lock lock(mDevicesMutex);
+    mAttachListener = std::move(listener);
+}
+
+void DeviceManager::setDetachListener(DeviceManager::DeviceListener listener)
+{
+    std::scoped_lock lock(mDevicesMutex);
+    mDetachListener = std::move(listener);
+}
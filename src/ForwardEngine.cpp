@@ -0,0 +1,611 @@
+#include "ForwardEngine.hpp"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "SmartSocket.hpp"
+
+
+namespace {
+    // epoll_event.data.u64 = tag | id
+    constexpr uint64_t TAG_SHIFT = 62;
+    constexpr uint64_t ID_MASK = (uint64_t{1} << TAG_SHIFT) - 1;
+
+    enum Tag : uint64_t {
+        WAKE = 0,
+        LISTENER = 1,
+        CONNECTION = 2,
+    };
+
+    uint64_t makeKey(Tag tag, uint64_t id)
+    {
+        return (uint64_t{tag} << TAG_SHIFT) | (id & ID_MASK);
+    }
+
+    bool setNonBlocking(int fd)
+    {
+        int flags = fcntl(fd, F_GETFL, 0);
+        return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+}
+
+
+ForwardEngine::Forward::Forward(ForwardId id,
+                                int listenFd,
+                                uint16_t port,
+                                const AdbDevice::SharedPointer& device,
+                                std::string destination)
+    : id(id)
+    , listenFd(listenFd)
+    , port(port)
+    , device(device)
+    , destination(std::move(destination))
+    , pool(device->getMaxData())
+{}
+
+ForwardEngine::Connection::Connection(int fd, SharedForward forward)
+    : fd(fd)
+    , forward(std::move(forward))
+{}
+
+ForwardEngine::Mailbox::Mailbox(int wakeFd)
+    : wakeFd(wakeFd)
+{}
+
+ForwardEngine::Mailbox::~Mailbox()
+{
+    ::close(wakeFd);
+}
+
+bool ForwardEngine::Mailbox::post(Event&& event)
+{
+    std::unique_lock lock(mutex);
+    if (closed)
+        return false;
+
+    bool wasEmpty = events.empty();
+    events.push_back(std::move(event));
+    lock.unlock();
+
+    if (wasEmpty) { // otherwise the engine is woken up already
+        uint64_t one = 1;
+        [[maybe_unused]] auto written = ::write(wakeFd, &one, sizeof(one));
+    }
+    return true;
+}
+
+std::vector<ForwardEngine::Event> ForwardEngine::Mailbox::take()
+{
+    uint64_t count;
+    [[maybe_unused]] auto read = ::read(wakeFd, &count, sizeof(count));
+
+    std::vector<Event> taken;
+    std::scoped_lock lock(mutex);
+    taken.swap(events);
+    return taken;
+}
+
+void ForwardEngine::Mailbox::close()
+{
+    std::scoped_lock lock(mutex);
+    closed = true;
+}
+
+ForwardEngine::UniquePointer ForwardEngine::make()
+{
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0)
+        return nullptr;
+
+    int wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd < 0) {
+        ::close(epollFd);
+        return nullptr;
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = makeKey(WAKE, 0);
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) != 0) {
+        ::close(wakeFd);
+        ::close(epollFd);
+        return nullptr;
+    }
+
+    return UniquePointer{new ForwardEngine(epollFd, std::make_shared<Mailbox>(wakeFd))};
+}
+
+ForwardEngine::ForwardEngine(int epollFd, std::shared_ptr<Mailbox> mailbox)
+    : mEpollFd(epollFd)
+    , mMailbox(std::move(mailbox))
+    , mRunning(true)
+{
+    mThread = std::thread([this] { run(); });
+}
+
+ForwardEngine::~ForwardEngine()
+{
+    stop();
+    ::close(mEpollFd);
+}
+
+std::optional<ForwardEngine::ForwardId> ForwardEngine::forward(const AdbDevice::SharedPointer& device,
+                                                               uint16_t localPort,
+                                                               const std::string& destination)
+{
+    if (!device || !device->isConnected() || !mRunning)
+        return std::nullopt;
+
+    int listenFd = SmartSocket::listen(SmartSocket::Endpoint::local(localPort));
+    if (listenFd < 0)
+        return std::nullopt;
+
+    sockaddr_in address{};
+    socklen_t length = sizeof(address);
+    if (!setNonBlocking(listenFd) || getsockname(listenFd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+        SmartSocket::close(listenFd);
+        return std::nullopt;
+    }
+
+    std::unique_lock lock(mForwardsMutex);
+    auto id = ++mLastForwardId;
+    auto forward = std::make_shared<Forward>(id, listenFd, ntohs(address.sin_port), device, destination);
+    mForwards.emplace(id, forward);
+    lock.unlock();
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = makeKey(LISTENER, id);
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, listenFd, &event) != 0) {
+        lock.lock();
+        mForwards.erase(id);
+        lock.unlock();
+        SmartSocket::close(listenFd);
+        return std::nullopt;
+    }
+
+    return id;
+}
+
+bool ForwardEngine::removeForward(ForwardId id)
+{
+    std::unique_lock lock(mForwardsMutex);
+    auto it = mForwards.find(id);
+    if (it == mForwards.end())
+        return false;
+
+    auto forward = std::move(it->second);
+    mForwards.erase(it);
+    lock.unlock();
+
+    // The listener and connections belong to the engine thread
+    mMailbox->post(Event{Event::REMOVE_FORWARD, 0, std::nullopt, Transport::OK, std::move(forward)});
+    return true;
+}
+
+int ForwardEngine::attach(const AdbDevice::SharedPointer& device, AdbDevice::Streams streams)
+{
+    if (!device || !mRunning)
+        return -1;
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0)
+        return -1;
+    if (!adopt(device, std::move(streams), fds[0])) {
+        ::close(fds[1]);
+        return -1;
+    }
+    return fds[1];
+}
+
+bool ForwardEngine::adopt(const AdbDevice::SharedPointer& device, AdbDevice::Streams streams, int fd)
+{
+    if (!device || !mRunning || !setNonBlocking(fd)) {
+        ::close(fd);
+        return false;
+    }
+
+    // Not listed among the forwards: the record only carries the buffer pool and counters of the connection
+    auto forward = std::make_shared<Forward>(0, -1, 0, device, std::string{});
+    Event event{Event::ATTACH, 0, std::move(streams), Transport::OK, std::move(forward)};
+    event.fd = fd;
+    if (!mMailbox->post(std::move(event))) { // stopped meanwhile, the streams close with the event
+        ::close(fd);
+        return false;
+    }
+    return true;
+}
+
+void ForwardEngine::stop()
+{
+    if (!mRunning.exchange(false))
+        return;
+
+    uint64_t one = 1;
+    [[maybe_unused]] auto written = ::write(mMailbox->wakeFd, &one, sizeof(one));
+    if (mThread.joinable())
+        mThread.join();
+
+    // The thread is gone, clean up on its behalf. Events that made it into the mailbox are processed,
+    // so attached fds and opened streams end up in connections closed below; later ones are refused
+    mMailbox->close();
+    processEvents();
+    std::unique_lock lock(mForwardsMutex);
+    auto forwards = std::move(mForwards);
+    mForwards.clear();
+    lock.unlock();
+
+    for (auto& [id, forward] : forwards)
+        removeForwardNow(forward);
+
+    while (!mConnections.empty())
+        closeConnection(mConnections.begin()->first);
+}
+
+std::optional<uint16_t> ForwardEngine::getLocalPort(ForwardId id) const
+{
+    std::scoped_lock lock(mForwardsMutex);
+    auto it = mForwards.find(id);
+    if (it == mForwards.end())
+        return std::nullopt;
+    return it->second->port;
+}
+
+std::optional<ForwardEngine::Counters> ForwardEngine::getCounters(ForwardId id) const
+{
+    std::scoped_lock lock(mForwardsMutex);
+    auto it = mForwards.find(id);
+    if (it == mForwards.end())
+        return std::nullopt;
+
+    const auto& forward = *it->second;
+    return Counters{forward.acceptedConnections.load(std::memory_order_relaxed),
+                    forward.activeConnections.load(std::memory_order_relaxed),
+                    forward.failedOpens.load(std::memory_order_relaxed),
+                    forward.bytesToDevice.load(std::memory_order_relaxed),
+                    forward.bytesFromDevice.load(std::memory_order_relaxed)};
+}
+
+std::vector<ForwardEngine::ForwardId> ForwardEngine::getForwards() const
+{
+    std::scoped_lock lock(mForwardsMutex);
+    std::vector<ForwardId> ids;
+    ids.reserve(mForwards.size());
+    for (const auto& [id, forward] : mForwards)
+        ids.push_back(id);
+    return ids;
+}
+
+void ForwardEngine::run()
+{
+    constexpr int MAX_EVENTS = 256;
+    epoll_event events[MAX_EVENTS];
+
+    while (mRunning) {
+        int count = epoll_wait(mEpollFd, events, MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            auto key = events[i].data.u64;
+            auto id = key & ID_MASK;
+            switch (key >> TAG_SHIFT) {
+                case WAKE:
+                    processEvents();
+                    break;
+                case LISTENER:
+                    acceptConnections(static_cast<ForwardId>(id));
+                    break;
+                case CONNECTION:
+                    onSocketEvents(id, events[i].events);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+void ForwardEngine::processEvents()
+{
+    for (auto& event : mMailbox->take()) {
+        switch (event.type) {
+            case Event::OPENED:
+                onOpened(event.connectionId, std::move(event.streams));
+                break;
+            case Event::READABLE: {
+                auto it = mConnections.find(event.connectionId);
+                if (it == mConnections.end())
+                    break;
+                pumpFromDevice(it->second);
+                if (it->second.closing)
+                    closeConnection(event.connectionId);
+                else
+                    updateEvents(event.connectionId, it->second);
+                break;
+            }
+            case Event::WRITTEN:
+                onWritten(event.connectionId, event.errorCode);
+                break;
+            case Event::REMOVE_FORWARD:
+                removeForwardNow(event.forward);
+                break;
+            case Event::ATTACH:
+                onAttach(std::move(event));
+                break;
+        }
+    }
+}
+
+void ForwardEngine::acceptConnections(ForwardId forwardId)
+{
+    std::unique_lock lock(mForwardsMutex);
+    auto it = mForwards.find(forwardId);
+    if (it == mForwards.end())
+        return;
+    auto forward = it->second;
+    lock.unlock();
+
+    while (true) {
+        int fd = accept4(forward->listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            return; // EAGAIN or an error, either way nothing more to accept now
+        }
+
+        auto device = forward->device.lock();
+        if (!device || !device->isConnected()) {
+            ::close(fd);
+            continue;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        auto connectionId = ++mLastConnectionId;
+        mConnections.emplace(connectionId, Connection{fd, forward});
+        forward->acceptedConnections.fetch_add(1, std::memory_order_relaxed);
+        forward->activeConnections.fetch_add(1, std::memory_order_relaxed);
+
+        WeakMailbox mailbox = mMailbox;
+        device->openAsync(forward->destination, [mailbox, connectionId](std::optional<AdbDevice::Streams> streams) {
+            if (auto shared = mailbox.lock())
+                shared->post(Event{Event::OPENED, connectionId, std::move(streams)});
+        });
+    }
+}
+
+void ForwardEngine::onAttach(Event&& event)
+{
+    auto connectionId = ++mLastConnectionId;
+    mConnections.emplace(connectionId, Connection{event.fd, event.forward});
+    event.forward->acceptedConnections.fetch_add(1, std::memory_order_relaxed);
+    event.forward->activeConnections.fetch_add(1, std::memory_order_relaxed);
+    onOpened(connectionId, std::move(event.streams));
+}
+
+void ForwardEngine::onOpened(uint64_t connectionId, std::optional<AdbDevice::Streams>&& streams)
+{
+    auto it = mConnections.find(connectionId);
+    if (it == mConnections.end())
+        return; // closed meanwhile, dropping the streams closes them too
+
+    auto& connection = it->second;
+    if (!streams) {
+        connection.forward->failedOpens.fetch_add(1, std::memory_order_relaxed);
+        closeConnection(connectionId);
+        return;
+    }
+
+    connection.streams = std::move(streams);
+    auto& istream = connection.streams->istream;
+    istream.setAckOnRead(true); // the device waits for the socket
+    WeakMailbox mailbox = mMailbox;
+    istream.setDataListener([mailbox, connectionId] {
+        if (auto shared = mailbox.lock())
+            shared->post(Event{Event::READABLE, connectionId});
+    });
+
+    pumpFromDevice(connection); // the device may have written before the listener was set
+    if (connection.closing)
+        closeConnection(connectionId);
+    else
+        updateEvents(connectionId, connection);
+}
+
+void ForwardEngine::onWritten(uint64_t connectionId, Transport::ErrorCode errorCode)
+{
+    auto it = mConnections.find(connectionId);
+    if (it == mConnections.end())
+        return;
+
+    auto& connection = it->second;
+    connection.writingToDevice = false;
+    if (errorCode != Transport::OK) {
+        closeConnection(connectionId);
+        return;
+    }
+
+    updateEvents(connectionId, connection);
+}
+
+void ForwardEngine::onSocketEvents(uint64_t connectionId, uint32_t events)
+{
+    auto it = mConnections.find(connectionId);
+    if (it == mConnections.end())
+        return;
+
+    auto& connection = it->second;
+    if (events & EPOLLOUT) {
+        if (flushToSocket(connection))
+            pumpFromDevice(connection);
+    }
+
+    if (events & (EPOLLHUP | EPOLLERR))
+        connection.closing = true; // reported even when not asked for, has to be handled now
+    else if (events & EPOLLIN)
+        pumpToDevice(connectionId, connection);
+
+    if (connection.closing)
+        closeConnection(connectionId);
+    else
+        updateEvents(connectionId, connection);
+}
+
+void ForwardEngine::pumpToDevice(uint64_t connectionId, Connection& connection)
+{
+    if (connection.writingToDevice || !connection.streams)
+        return;
+
+    auto& forward = connection.forward;
+    auto payload = forward->pool.acquire();
+    ssize_t received;
+    do {
+        received = ::recv(connection.fd, payload.getBuffer(), forward->pool.getBufferSize(), 0);
+    } while (received < 0 && errno == EINTR);
+
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        forward->pool.release(std::move(payload));
+        return;
+    }
+
+    if (received <= 0) { // EOF or an error, ADB streams can't be half-closed
+        forward->pool.release(std::move(payload));
+        connection.closing = true;
+        return;
+    }
+
+    payload.setDataSize(received);
+    forward->bytesToDevice.fetch_add(received, std::memory_order_relaxed);
+    connection.writingToDevice = true;
+
+    WeakMailbox mailbox = mMailbox;
+    connection.streams->ostream.write(std::move(payload), [mailbox, forward, connectionId](APacket* packet,
+                                                                                           Transport::ErrorCode code) {
+        if (packet && packet->hasPayload())
+            forward->pool.release(packet->movePayloadOut());
+        if (auto shared = mailbox.lock())
+            shared->post(Event{Event::WRITTEN, connectionId, std::nullopt, code});
+    });
+}
+
+void ForwardEngine::pumpFromDevice(Connection& connection)
+{
+    if (!connection.streams)
+        return;
+
+    auto& istream = connection.streams->istream;
+    while (!connection.closing) {
+        if (connection.toSocket && !flushToSocket(connection))
+            return; // the socket is full, EPOLLOUT resumes
+
+        auto payload = istream.tryRead();
+        if (!payload)
+            break;
+
+        if (payload->getSize() == 0)
+            continue;
+
+        connection.toSocket = std::move(payload);
+        connection.toSocketOffset = 0;
+    }
+
+    if (!istream.isOpen() && istream.isEmpty() && !connection.toSocket)
+        connection.closing = true; // closed by the device and everything is delivered
+}
+
+bool ForwardEngine::flushToSocket(Connection& connection)
+{
+    if (!connection.toSocket)
+        return true;
+
+    auto& payload = *connection.toSocket;
+    while (connection.toSocketOffset < payload.getSize()) {
+        auto sent = ::send(connection.fd,
+                           payload.getBuffer() + connection.toSocketOffset,
+                           payload.getSize() - connection.toSocketOffset,
+                           MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                connection.closing = true;
+            return false;
+        }
+
+        connection.toSocketOffset += sent;
+        connection.forward->bytesFromDevice.fetch_add(sent, std::memory_order_relaxed);
+    }
+
+    connection.forward->pool.release(std::move(payload));
+    connection.toSocket.reset();
+    return true;
+}
+
+void ForwardEngine::updateEvents(uint64_t connectionId, Connection& connection)
+{
+    if (!connection.streams)
+        return; // not registered until the stream is open
+
+    uint32_t events = 0;
+    if (!connection.writingToDevice)
+        events |= EPOLLIN;
+    if (connection.toSocket)
+        events |= EPOLLOUT;
+
+    if (events == connection.events && connection.registered)
+        return;
+
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = makeKey(CONNECTION, connectionId);
+    auto operation = connection.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(mEpollFd, operation, connection.fd, &event) == 0) {
+        connection.events = events;
+        connection.registered = true;
+    }
+}
+
+void ForwardEngine::closeConnection(uint64_t connectionId)
+{
+    auto it = mConnections.find(connectionId);
+    if (it == mConnections.end())
+        return;
+
+    auto& connection = it->second;
+    if (connection.registered)
+        epoll_ctl(mEpollFd, EPOLL_CTL_DEL, connection.fd, nullptr);
+    ::close(connection.fd);
+
+    if (connection.streams)
+        connection.streams->istream.setDataListener({});
+    connection.forward->activeConnections.fetch_sub(1, std::memory_order_relaxed);
+    mConnections.erase(it); // dropping the streams sends CLSE
+}
+
+void ForwardEngine::removeForwardNow(const SharedForward& forward)
+{
+    if (forward->listenFd >= 0) {
+        epoll_ctl(mEpollFd, EPOLL_CTL_DEL, forward->listenFd, nullptr);
+        SmartSocket::close(forward->listenFd);
+        forward->listenFd = -1;
+    }
+
+    std::vector<uint64_t> connections;
+    for (const auto& [id, connection] : mConnections)
+        if (connection.forward == forward)
+            connections.push_back(id);
+
+    for (auto id : connections)
+        closeConnection(id);
+}
@@ -0,0 +1,120 @@
+#include "KeyStore.hpp"
+
+#include <fstream>
+
+#include "utils.hpp"
+
+
+KeyStore::PrivateKey::PrivateKey(mbedtls_pk_context* context)
+    : mContext(context)
+{}
+
+KeyStore::PrivateKey::~PrivateKey()
+{
+    utils::crypto::freePkContext(mContext);
+}
+
+bool KeyStore::PrivateKey::sign(const uint8_t* hash, size_t hashLen, uint8_t* signature, size_t signatureLen)
+{
+    std::scoped_lock lock(mMutex);
+    return utils::crypto::sign(mContext, hash, hashLen, signature, signatureLen);
+}
+
+KeyStore::KeyStore()
+    : mWorkers(SIGNING_THREADS)
+{}
+
+KeyStore& KeyStore::shared()
+{
+    static KeyStore store;
+    return store;
+}
+
+std::optional<std::filesystem::file_time_type> KeyStore::modificationTime(const std::string& path)
+{
+    std::error_code error;
+    auto time = std::filesystem::last_write_time(path, error);
+    if (error)
+        return std::nullopt;
+    return time;
+}
+
+KeyStore::SharedPrivateKey KeyStore::getPrivateKey(const std::string& path)
+{
+    auto modified = modificationTime(path);
+    if (!modified)
+        return nullptr;
+
+    {
+        std::scoped_lock lock(mMutex);
+        auto it = mPrivateKeys.find(path);
+        if (it != mPrivateKeys.end() && it->second.modified == *modified)
+            return it->second.value;
+    }
+
+    // Parse outside the lock, other devices keep using cached keys meanwhile
+    SharedPrivateKey key;
+    auto* context = utils::crypto::makePkContextFromPem(path);
+    if (context)
+        key.reset(new PrivateKey(context));
+
+    std::scoped_lock lock(mMutex);
+    mPrivateKeys[path] = {*modified, key}; // invalid files are cached too
+    return key;
+}
+
+std::optional<APayload> KeyStore::getPublicKey(const std::string& path)
+{
+    auto modified = modificationTime(path);
+    if (!modified)
+        return std::nullopt;
+
+    {
+        std::scoped_lock lock(mMutex);
+        auto it = mPublicKeys.find(path);
+        if (it != mPublicKeys.end() && it->second.modified == *modified)
+            return it->second.value;
+    }
+
+    std::optional<APayload> key;
+    std::ifstream fin(path, std::ios::binary);
+    std::error_code error;
+    auto size = std::filesystem::file_size(path, error);
+    if (fin.is_open() && !error) {
+        key.emplace(size);
+        key->setDataSize(size);
+        if (!fin.read(reinterpret_cast<char*>(key->getBuffer()), static_cast<std::streamsize>(size)))
+            key.reset();
+    }
+
+    std::scoped_lock lock(mMutex);
+    mPublicKeys[path] = {*modified, key};
+    return key;
+}
+
+void KeyStore::setAcceptedKey(const std::string& serial, const std::string& path)
+{
+    std::scoped_lock lock(mMutex);
+    mAcceptedKeys[serial] = path;
+}
+
+std::optional<std::string> KeyStore::getAcceptedKey(const std::string& serial) const
+{
+    std::scoped_lock lock(mMutex);
+    auto it = mAcceptedKeys.find(serial);
+    if (it == mAcceptedKeys.end())
+        return std::nullopt;
+    return it->second;
+}
+
+bool KeyStore::post(ThreadPool::Task task)
+{
+    return mWorkers.post(std::move(task));
+}
+
+void KeyStore::clear()
+{
+    std::scoped_lock lock(mMutex);
+    mPrivateKeys.clear();
+    mPublicKeys.clear();
+}
@@ -0,0 +1,90 @@
+#include "Parker.hpp"
+
+#include <thread>
+
+#ifdef __linux__
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+void Parker::relax()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+}
+
+bool Parker::canSpin()
+{
+    static const bool multiprocessor = std::thread::hardware_concurrency() > 1;
+    return multiprocessor;
+}
+
+void Parker::notifyAll()
+{
+    mEpoch.fetch_add(1);
+    if (mSleepers.load() != 0 && !mWakePending.exchange(true))
+        wake();
+}
+
+#ifdef __linux__
+
+bool Parker::park(uint32_t epoch, Clock::time_point deadline)
+{
+    timespec timeout{};
+    timespec* timeoutPointer = nullptr;
+    if (deadline != Clock::time_point::max()) {
+        auto left = deadline - Clock::now();
+        if (left <= Clock::duration::zero())
+            return false;
+
+        auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+        timeout.tv_sec = static_cast<time_t>(nanoseconds / 1'000'000'000);
+        timeout.tv_nsec = static_cast<long>(nanoseconds % 1'000'000'000);
+        timeoutPointer = &timeout;
+    }
+
+    // Returns right away if the epoch has moved since the caller's check
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&mEpoch), FUTEX_WAIT_PRIVATE, epoch, timeoutPointer, nullptr, 0);
+    return Clock::now() < deadline;
+}
+
+void Parker::wake()
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&mEpoch), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+#else
+
+bool Parker::park(uint32_t epoch, Clock::time_point deadline)
+{
+    std::unique_lock lock(mMutex);
+    auto moved = [&] { return mEpoch.load() != epoch; };
+    if (deadline == Clock::time_point::max()) {
+        mCondition.wait(lock, moved);
+        return true;
+    }
+    return mCondition.wait_until(lock, deadline, moved);
+}
+
+void Parker::wake()
+{
+    // Under the mutex: a waiter between its epoch check and wait() doesn't miss it
+    std::unique_lock lock(mMutex);
+    lock.unlock();
+    mCondition.notify_all();
+}
+
+#endif
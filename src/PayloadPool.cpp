@@ -0,0 +1,38 @@
+#include "PayloadPool.hpp"
+
+
+PayloadPool::PayloadPool(size_t bufferSize, size_t maxCached)
+    : mBufferSize(bufferSize)
+    , mMaxCached(maxCached)
+{}
+
+APayload PayloadPool::acquire()
+{
+    std::unique_lock lock(mMutex);
+    if (mFree.empty()) {
+        lock.unlock();
+        return APayload{mBufferSize};
+    }
+
+    auto payload = std::move(mFree.back());
+    mFree.pop_back();
+    lock.unlock();
+
+    payload.setDataSize(0);
+    return payload;
+}
+
+void PayloadPool::release(APayload&& payload)
+{
+    if (payload.getBufferSize() < mBufferSize)
+        return;
+
+    std::scoped_lock lock(mMutex);
+    if (mFree.size() < mMaxCached)
+        mFree.push_back(std::move(payload));
+}
+
+size_t PayloadPool::getBufferSize() const
+{
+    return mBufferSize;
+}
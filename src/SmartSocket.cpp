@@ -0,0 +1,347 @@
+#include "SmartSocket.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "utils.hpp"
+
+
+SmartSocket::Endpoint SmartSocket::Endpoint::local(uint16_t port)
+{
+    return {"127.0.0.1", port, {}};
+}
+
+SmartSocket::Endpoint SmartSocket::Endpoint::unixSocket(const std::string& path)
+{
+    return {{}, 0, path};
+}
+
+static bool makeUnixAddress(const std::string& path, sockaddr_un& address)
+{
+    if (path.size() >= sizeof(address.sun_path))
+        return false;
+
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+static bool makeInetAddress(const SmartSocket::Endpoint& endpoint, sockaddr_in& address)
+{
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(endpoint.port);
+    return inet_pton(AF_INET, endpoint.host.c_str(), &address.sin_addr) == 1;
+}
+
+#ifdef MSG_NOSIGNAL
+const int SmartSocket::NO_SIGNAL = MSG_NOSIGNAL;
+#else
+const int SmartSocket::NO_SIGNAL = 0;
+#endif
+
+static bool setCloseOnExec(int fd)
+{
+    int flags = fcntl(fd, F_GETFD, 0);
+    return flags >= 0 && fcntl(fd, F_SETFD, flags | FD_CLOEXEC) == 0;
+}
+
+int SmartSocket::openSocket(int domain)
+{
+    int fd = ::socket(domain, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    if (!setCloseOnExec(fd)) {
+        ::close(fd);
+        return -1;
+    }
+    disableSigPipe(fd);
+    return fd;
+}
+
+bool SmartSocket::openPipe(int fds[2])
+{
+    if (::pipe(fds) != 0)
+        return false;
+
+    for (int i = 0; i < 2; ++i) {
+        if (!setCloseOnExec(fds[i]) || !setNonBlocking(fds[i])) {
+            ::close(fds[0]);
+            ::close(fds[1]);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SmartSocket::setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+void SmartSocket::disableSigPipe([[maybe_unused]] int fd)
+{
+#if !defined(MSG_NOSIGNAL) && defined(SO_NOSIGPIPE)
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+}
+
+int SmartSocket::connect(const Endpoint& endpoint)
+{
+    if (!endpoint.unixSocketPath.empty()) {
+        sockaddr_un address{};
+        if (!makeUnixAddress(endpoint.unixSocketPath, address))
+            return -1;
+
+        int fd = openSocket(AF_UNIX);
+        if (fd < 0)
+            return -1;
+
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    sockaddr_in address{};
+    if (!makeInetAddress(endpoint, address))
+        return -1;
+
+    int fd = openSocket(AF_INET);
+    if (fd < 0)
+        return -1;
+
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+int SmartSocket::listen(const Endpoint& endpoint, int backlog)
+{
+    int fd;
+    if (!endpoint.unixSocketPath.empty()) {
+        sockaddr_un address{};
+        if (!makeUnixAddress(endpoint.unixSocketPath, address))
+            return -1;
+
+        fd = openSocket(AF_UNIX);
+        if (fd < 0)
+            return -1;
+
+        ::unlink(endpoint.unixSocketPath.c_str());
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            ::close(fd);
+            return -1;
+        }
+    }
+    else {
+        sockaddr_in address{};
+        if (!makeInetAddress(endpoint, address))
+            return -1;
+
+        fd = openSocket(AF_INET);
+        if (fd < 0)
+            return -1;
+
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            ::close(fd);
+            return -1;
+        }
+    }
+
+    if (::listen(fd, backlog) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void SmartSocket::close(int fd)
+{
+    if (fd >= 0)
+        ::close(fd);
+}
+
+bool SmartSocket::writeFully(int fd, const void* data, size_t size)
+{
+    auto* ptr = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        auto written = ::send(fd, ptr, size, NO_SIGNAL);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+
+        ptr += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool SmartSocket::readFully(int fd, void* data, size_t size)
+{
+    auto* ptr = static_cast<uint8_t*>(data);
+    while (size > 0) {
+        auto received = ::recv(fd, ptr, size, 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return false;
+
+        ptr += received;
+        size -= received;
+    }
+    return true;
+}
+
+std::string SmartSocket::formatLength(size_t length)
+{
+    char buffer[5];
+    std::snprintf(buffer, sizeof(buffer), "%04zx", length & 0xffff);
+    return buffer;
+}
+
+static std::optional<size_t> readLength(int fd)
+{
+    char buffer[5] = {};
+    if (!SmartSocket::readFully(fd, buffer, 4))
+        return std::nullopt;
+
+    char* end = nullptr;
+    auto length = std::strtoul(buffer, &end, 16);
+    if (end != buffer + 4)
+        return std::nullopt;
+    return length;
+}
+
+bool SmartSocket::sendRequest(int fd, std::string_view request)
+{
+    auto message = formatLength(request.size());
+    message += request;
+    return writeFully(fd, message.data(), message.size());
+}
+
+bool SmartSocket::readStatus(int fd, std::string* failMessage)
+{
+    char status[4];
+    if (!readFully(fd, status, 4))
+        return false;
+
+    if (std::memcmp(status, "OKAY", 4) == 0)
+        return true;
+
+    if (failMessage) {
+        if (std::memcmp(status, "FAIL", 4) == 0)
+            *failMessage = readLengthPrefixed(fd).value_or("");
+        else
+            *failMessage = "protocol fault (status " + std::string(status, 4) + ")";
+    }
+    return false;
+}
+
+std::optional<std::string> SmartSocket::readLengthPrefixed(int fd)
+{
+    auto length = readLength(fd);
+    if (!length)
+        return std::nullopt;
+
+    std::string result(*length, '\0');
+    if (!readFully(fd, result.data(), result.size()))
+        return std::nullopt;
+    return result;
+}
+
+int SmartSocket::request(const Endpoint& endpoint, std::string_view request, std::string* failMessage)
+{
+    int fd = connect(endpoint);
+    if (fd < 0)
+        return -1;
+
+    if (!sendRequest(fd, request) || !readStatus(fd, failMessage)) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+std::optional<std::string> SmartSocket::query(const Endpoint& endpoint, std::string_view request)
+{
+    int fd = SmartSocket::request(endpoint, request);
+    if (fd < 0)
+        return std::nullopt;
+
+    auto reply = readLengthPrefixed(fd);
+    ::close(fd);
+    return reply;
+}
+
+std::optional<std::string> SmartSocket::readRequest(int fd)
+{
+    return readLengthPrefixed(fd);
+}
+
+bool SmartSocket::writeOkay(int fd)
+{
+    return writeFully(fd, "OKAY", 4);
+}
+
+bool SmartSocket::writeOkay(int fd, std::string_view reply)
+{
+    std::string message = "OKAY" + formatLength(reply.size());
+    message += reply;
+    return writeFully(fd, message.data(), message.size());
+}
+
+bool SmartSocket::writeFail(int fd, std::string_view message)
+{
+    std::string reply = "FAIL" + formatLength(message.size());
+    reply += message;
+    return writeFully(fd, reply.data(), reply.size());
+}
+
+std::vector<SmartSocket::DeviceInfo> SmartSocket::parseDevices(std::string_view devicesLong)
+{
+    // <serial> <state> [key:value ...]\n
+    std::vector<DeviceInfo> devices;
+    for (auto line : utils::tokenize(devicesLong, "\n")) {
+        auto tokens = utils::tokenize(line, " \t");
+        std::vector<std::string_view> words;
+        for (auto token : tokens)
+            if (!token.empty())
+                words.push_back(token);
+
+        if (words.size() < 2)
+            continue;
+
+        DeviceInfo info{std::string(words[0]), std::string(words[1]), {}};
+        for (size_t i = 2; i < words.size(); ++i) {
+            auto colon = words[i].find(':');
+            if (colon == std::string_view::npos)
+                continue;
+            info.properties.emplace(words[i].substr(0, colon), words[i].substr(colon + 1));
+        }
+        devices.push_back(std::move(info));
+    }
+    return devices;
+}
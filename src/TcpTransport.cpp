@@ -0,0 +1,412 @@
+#include "TcpTransport.hpp"
+
+#include <cerrno>
+#include <climits>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "SmartSocket.hpp"
+
+
+constexpr size_t READ_BATCH = 64;         // packets parsed per wake-up before writes get a turn
+constexpr size_t INCOMING_BACKLOG = 64;   // undelivered packets that stop reading from the socket
+constexpr size_t WRITE_VECTORS = 128;     // iovecs per sendmsg, even
+
+static bool writeVectors(int fd, iovec* vectors, size_t count)
+{
+    while (count > 0) {
+        msghdr message{};
+        message.msg_iov = vectors;
+        message.msg_iovlen = count;
+
+        auto sent = ::sendmsg(fd, &message, SmartSocket::NO_SIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        // Skip what went out, partially sent vector is adjusted in place
+        auto left = static_cast<size_t>(sent);
+        while (count > 0 && left >= vectors->iov_len) {
+            left -= vectors->iov_len;
+            ++vectors;
+            --count;
+        }
+        if (count > 0) {
+            vectors->iov_base = static_cast<uint8_t*>(vectors->iov_base) + left;
+            vectors->iov_len -= left;
+        }
+    }
+    return true;
+}
+
+TcpTransport::TcpTransport(int fd)
+    : mFd(fd)
+    , mRunning(true)
+    , mTlsActive(false)
+{
+    mMaxPayloadSize = MAX_PAYLOAD;
+
+    if (!SmartSocket::openPipe(mWakePipe)) {
+        mRunning = false;
+        return;
+    }
+
+    mThread = std::thread([this] { run(); });
+}
+
+TcpTransport::~TcpTransport()
+{
+    mRunning = false;
+    wake();
+    if (mThread.joinable())
+        mThread.join();
+
+    if (mTls && !mDisconnected)
+        mTls->closeNotify();
+    mTls.reset();
+
+    std::unique_lock lock(mOutgoingMutex);
+    auto outgoing = std::move(mOutgoing);
+    lock.unlock();
+
+    for (auto& entry : outgoing) {
+        if (!entry.packet)
+            continue;
+        if (entry.completion)
+            entry.completion(&*entry.packet, CANCELLED);
+        notifySendListener(&*entry.packet, CANCELLED);
+    }
+
+    SmartSocket::close(mFd);
+    SmartSocket::close(mWakePipe[0]);
+    SmartSocket::close(mWakePipe[1]);
+}
+
+std::unique_ptr<TcpTransport> TcpTransport::make(const std::string& host, uint16_t port)
+{
+    int fd = SmartSocket::connect({host, port, {}});
+    if (fd < 0)
+        return {};
+    return make(fd);
+}
+
+std::unique_ptr<TcpTransport> TcpTransport::make(int fd)
+{
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // fails harmlessly on unix sockets
+    SmartSocket::disableSigPipe(fd);
+
+    std::unique_ptr<TcpTransport> transport{new TcpTransport{fd}};
+    if (!transport->mRunning)
+        return {};
+    return transport;
+}
+
+bool TcpTransport::isTlsActive() const
+{
+    return mTlsActive;
+}
+
+std::string TcpTransport::getCiphersuite() const
+{
+    std::scoped_lock lock(mCiphersuiteMutex);
+    return mCiphersuite;
+}
+
+void TcpTransport::send(APacket&& packet, Completion completion)
+{
+    std::unique_lock lock(mOutgoingMutex);
+    if (mStopped) {
+        lock.unlock();
+        if (completion)
+            completion(&packet, TRANSPORT_DISCONNECTED);
+        notifySendListener(&packet, TRANSPORT_DISCONNECTED);
+        return;
+    }
+    mOutgoing.push_back({std::move(packet), std::move(completion), std::nullopt});
+    lock.unlock();
+
+    if (mThread.get_id() != std::this_thread::get_id()) // the worker flushes before it polls again
+        wake();
+}
+
+void TcpTransport::receive()
+{
+    std::unique_lock lock(mIncomingMutex);
+    mReceiveRequested = true;
+    lock.unlock();
+
+    if (mThread.get_id() != std::this_thread::get_id())
+        wake();
+}
+
+bool TcpTransport::startTls(const TlsConfig& config)
+{
+    // Queued behind the packets sent so far: they leave in plaintext, the STLS reply among them
+    std::unique_lock lock(mOutgoingMutex);
+    if (mStopped)
+        return false;
+    mOutgoing.push_back({std::nullopt, {}, config});
+    lock.unlock();
+
+    if (mThread.get_id() != std::this_thread::get_id())
+        wake();
+    return true;
+}
+
+void TcpTransport::wake()
+{
+    char byte = 0;
+    [[maybe_unused]] auto res = ::write(mWakePipe[1], &byte, 1); // full pipe means a wake-up is pending anyway
+}
+
+void TcpTransport::run()
+{
+    while (mRunning) {
+        flushOutgoing();
+
+        std::unique_lock lock(mIncomingMutex);
+        bool reading = !mDisconnected && mIncoming.size() < INCOMING_BACKLOG;
+        lock.unlock();
+
+        // Decrypted data may wait in mbedTLS while the socket itself is drained
+        bool buffered = reading && mTls && mTls->getBufferedSize() > 0;
+
+        pollfd pollFds[2] = {
+                {mWakePipe[0], POLLIN, 0},
+                {mFd, static_cast<short>(reading ? POLLIN : 0), 0}
+        };
+        int res = ::poll(pollFds, reading ? 2 : 1, buffered ? 0 : -1);
+        if (res < 0 && errno != EINTR) {
+            // Without the worker nothing moves anymore: pending sends fail, the listener learns about it
+            disconnect();
+            std::unique_lock outgoingLock(mOutgoingMutex);
+            mStopped = true;
+            outgoingLock.unlock();
+
+            flushOutgoing();
+            deliver();
+            break;
+        }
+
+        if (pollFds[0].revents & POLLIN) {
+            char buffer[256];
+            while (::read(mWakePipe[0], buffer, sizeof(buffer)) > 0)
+                ;
+        }
+
+        if (reading && (buffered || (pollFds[1].revents & (POLLIN | POLLHUP | POLLERR))) && !readAvailable())
+            disconnect();
+
+        deliver();
+    }
+}
+
+void TcpTransport::flushOutgoing()
+{
+    std::deque<Outgoing> outgoing;
+    std::unique_lock lock(mOutgoingMutex);
+    outgoing.swap(mOutgoing);
+    lock.unlock();
+
+    while (!outgoing.empty()) {
+        if (outgoing.front().tlsConfig) {
+            auto config = std::move(*outgoing.front().tlsConfig);
+            outgoing.pop_front();
+            if (!mDisconnected && !switchToTls(config))
+                disconnect();
+            continue;
+        }
+
+        // Packets up to the next TLS switch go out together
+        std::deque<Outgoing> batch;
+        while (!outgoing.empty() && outgoing.front().packet) {
+            batch.push_back(std::move(outgoing.front()));
+            outgoing.pop_front();
+        }
+
+        bool written = !mDisconnected && (mTls ? writeTls(batch) : writePlain(batch));
+        if (!written)
+            disconnect();
+
+        auto errorCode = written ? OK : TRANSPORT_DISCONNECTED;
+        for (auto& entry : batch) {
+            if (entry.completion)
+                entry.completion(&*entry.packet, errorCode);
+            notifySendListener(&*entry.packet, errorCode);
+        }
+    }
+}
+
+bool TcpTransport::writePlain(std::deque<Outgoing>& batch)
+{
+    // Headers and payloads straight from the packets, one syscall for many packets
+    std::vector<iovec> vectors;
+    vectors.reserve(std::min(batch.size() * 2, WRITE_VECTORS));
+
+    for (auto& entry : batch) {
+        auto& packet = *entry.packet;
+        vectors.push_back({&packet.getMessage(), sizeof(AMessage)});
+        if (packet.hasPayload() && packet.getPayload().getSize() > 0)
+            vectors.push_back({packet.getPayload().getBuffer(), packet.getPayload().getSize()});
+
+        if (vectors.size() + 2 > WRITE_VECTORS) {
+            if (!writeVectors(mFd, vectors.data(), vectors.size()))
+                return false;
+            vectors.clear();
+        }
+    }
+
+    return vectors.empty() || writeVectors(mFd, vectors.data(), vectors.size());
+}
+
+bool TcpTransport::writeTls(std::deque<Outgoing>& batch)
+{
+    // A header alone would take a whole record. Packets are coalesced up to maxdata,
+    // mbedTLS cuts that into full-size records (16 KiB is TLS's limit)
+    auto flushSize = mMaxPayloadSize + sizeof(AMessage);
+    mRecordBuffer.clear();
+
+    for (auto& entry : batch) {
+        const auto& packet = *entry.packet;
+        const auto* header = reinterpret_cast<const uint8_t*>(&packet.getMessage());
+        mRecordBuffer.insert(mRecordBuffer.end(), header, header + sizeof(AMessage));
+        if (packet.hasPayload())
+            mRecordBuffer.insert(mRecordBuffer.end(), packet.getPayload().begin(), packet.getPayload().end());
+
+        if (mRecordBuffer.size() >= flushSize) {
+            if (!mTls->write(mRecordBuffer.data(), mRecordBuffer.size()))
+                return false;
+            mRecordBuffer.clear();
+        }
+    }
+
+    return mRecordBuffer.empty() || mTls->write(mRecordBuffer.data(), mRecordBuffer.size());
+}
+
+bool TcpTransport::switchToTls(const TlsConfig& config)
+{
+    // adbd is the TLS server, the host connects as a client
+    mTls = TlsSession::make(TlsSession::CLIENT, config, mFd);
+    if (!mTls || !mTls->handshake(HANDSHAKE_TIMEOUT))
+        return false;
+
+    std::unique_lock lock(mCiphersuiteMutex);
+    mCiphersuite = mTls->getCiphersuite();
+    lock.unlock();
+
+    mTlsActive = true;
+    return true;
+}
+
+bool TcpTransport::readAvailable()
+{
+    // Reads exactly up to the end of the current packet, nothing past STLS is consumed as plaintext
+    size_t packets = 0;
+    while (packets < READ_BATCH) {
+        if (mHeaderRead < sizeof(AMessage)) {
+            auto* header = reinterpret_cast<uint8_t*>(&mHeader);
+            auto res = readSome(header + mHeaderRead, sizeof(AMessage) - mHeaderRead);
+            if (res <= 0)
+                return res == 0;
+
+            mHeaderRead += res;
+            if (mHeaderRead < sizeof(AMessage))
+                continue;
+
+            if ((mHeader.command ^ mHeader.magic) != ALL_ONES_UINT32 || mHeader.dataLength > MAX_PAYLOAD)
+                return false; // out of sync, can't recover
+
+            mPayloadRead = 0;
+            if (mHeader.dataLength > 0)
+                mPayload.emplace(mHeader.dataLength);
+        }
+
+        if (mPayload && mPayloadRead < mHeader.dataLength) {
+            auto res = readSome(mPayload->getBuffer() + mPayloadRead, mHeader.dataLength - mPayloadRead);
+            if (res <= 0)
+                return res == 0;
+
+            mPayloadRead += res;
+            if (mPayloadRead < mHeader.dataLength)
+                continue;
+            mPayload->setDataSize(mHeader.dataLength);
+        }
+
+        APacket packet(mHeader);
+        if (mPayload) {
+            packet.movePayloadIn(std::move(*mPayload));
+            mPayload.reset();
+        }
+        mHeaderRead = 0;
+
+        std::scoped_lock lock(mIncomingMutex);
+        mIncoming.push_back(std::move(packet));
+        ++packets;
+    }
+    return true;
+}
+
+long TcpTransport::readSome(uint8_t* data, size_t size)
+{
+    if (mTls)
+        return mTls->read(data, size);
+
+    while (true) {
+        auto received = ::recv(mFd, data, size, MSG_DONTWAIT);
+        if (received > 0)
+            return received;
+        if (received == 0)
+            return -1; // EOF
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+        if (errno != EINTR)
+            return -1;
+    }
+}
+
+void TcpTransport::deliver()
+{
+    std::unique_lock lock(mIncomingMutex);
+    while (mReceiveRequested) {
+        if (!mIncoming.empty()) {
+            auto packet = std::move(mIncoming.front());
+            mIncoming.pop_front();
+            mReceiveRequested = false; // listener re-arms with receive()
+            lock.unlock();
+
+            notifyReceiveListener(&packet, OK);
+        }
+        else if (mDisconnected && !mDisconnectReported) {
+            mDisconnectReported = true;
+            mReceiveRequested = false;
+            lock.unlock();
+
+            APacket packet;
+            notifyReceiveListener(&packet, TRANSPORT_DISCONNECTED);
+        }
+        else {
+            break;
+        }
+
+        lock.lock();
+    }
+}
+
+void TcpTransport::disconnect()
+{
+    if (mDisconnected)
+        return;
+
+    // Sends fail from now on, the receive listener learns about it after the packets read so far
+    mDisconnected = true;
+    mTlsActive = false;
+    ::shutdown(mFd, SHUT_RDWR);
+}
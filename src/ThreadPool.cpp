@@ -0,0 +1,68 @@
+#include "ThreadPool.hpp"
+
+#include <cassert>
+
+
+ThreadPool::ThreadPool(size_t threadCount)
+{
+    if (threadCount == 0)
+        threadCount = 1;
+
+    mThreads.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i)
+        mThreads.emplace_back([this] { work(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+    stop();
+    for ([[maybe_unused]] auto& thread : mThreads)
+        assert(!thread.joinable() && "ThreadPool destroyed by its own task");
+}
+
+bool ThreadPool::post(ThreadPool::Task task)
+{
+    std::unique_lock lock(mMutex);
+    if (mStopping)
+        return false;
+
+    mTasks.push(std::move(task));
+    lock.unlock();
+    mCondition.notify_one();
+    return true;
+}
+
+void ThreadPool::stop()
+{
+    std::unique_lock lock(mMutex);
+    mStopping = true;
+    lock.unlock();
+    mCondition.notify_all();
+
+    // A detached worker would outlive the pool, the one running this task is left to the destructor
+    for (auto& thread : mThreads) {
+        if (thread.joinable() && thread.get_id() != std::this_thread::get_id())
+            thread.join();
+    }
+}
+
+size_t ThreadPool::getThreadCount() const
+{
+    return mThreads.size();
+}
+
+void ThreadPool::work()
+{
+    while (true) {
+        std::unique_lock lock(mMutex);
+        mCondition.wait(lock, [this] { return mStopping || !mTasks.empty(); });
+        if (mTasks.empty())
+            return; // stopping and nothing left to do
+
+        auto task = std::move(mTasks.front());
+        mTasks.pop();
+        lock.unlock();
+
+        task();
+    }
+}
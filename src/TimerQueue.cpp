@@ -0,0 +1,80 @@
+#include "TimerQueue.hpp"
+
+
+TimerQueue::TimerQueue()
+    : mThread([this] { run(); })
+{}
+
+TimerQueue::~TimerQueue()
+{
+    std::unique_lock lock(mMutex);
+    mStopping = true;
+    lock.unlock();
+    mChanged.notify_all();
+
+    if (mThread.joinable())
+        mThread.join();
+}
+
+TimerQueue& TimerQueue::shared()
+{
+    static TimerQueue queue;
+    return queue;
+}
+
+TimerQueue::Id TimerQueue::schedule(Clock::duration delay, Callback callback)
+{
+    return scheduleAt(Clock::now() + delay, std::move(callback));
+}
+
+TimerQueue::Id TimerQueue::scheduleAt(Clock::time_point deadline, Callback callback)
+{
+    std::unique_lock lock(mMutex);
+    auto id = ++mLastId;
+    bool earliest = mTimers.empty() || deadline < mTimers.begin()->first.first;
+    mTimers.emplace(Key{deadline, id}, std::move(callback));
+    mDeadlines.emplace(id, deadline);
+    lock.unlock();
+
+    if (earliest)
+        mChanged.notify_one();
+    return id;
+}
+
+bool TimerQueue::cancel(Id id)
+{
+    std::scoped_lock lock(mMutex);
+    auto it = mDeadlines.find(id);
+    if (it == mDeadlines.end())
+        return false;
+
+    mTimers.erase(Key{it->second, id});
+    mDeadlines.erase(it);
+    return true;
+}
+
+void TimerQueue::run()
+{
+    std::unique_lock lock(mMutex);
+    while (!mStopping) {
+        if (mTimers.empty()) {
+            mChanged.wait(lock);
+            continue;
+        }
+
+        auto first = mTimers.begin();
+        auto deadline = first->first.first;
+        if (Clock::now() < deadline) {
+            mChanged.wait_until(lock, deadline);
+            continue; // re-check, an earlier timer may have been added
+        }
+
+        auto callback = std::move(first->second);
+        mDeadlines.erase(first->first.second);
+        mTimers.erase(first);
+
+        lock.unlock();
+        callback();
+        lock.lock();
+    }
+}
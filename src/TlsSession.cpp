@@ -0,0 +1,191 @@
+#include "TlsSession.hpp"
+
+#include <cerrno>
+#include <mutex>
+
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <mbedtls/net_sockets.h>
+#include <psa/crypto.h>
+
+#include "SmartSocket.hpp"
+#include "utils.hpp"
+
+
+// AES-GCM first: mbedTLS runs it on AES-NI / ARMv8 crypto extensions when they are compiled in
+static const int CIPHERSUITES[] = {
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+        MBEDTLS_TLS1_3_AES_128_GCM_SHA256,
+        MBEDTLS_TLS1_3_AES_256_GCM_SHA384,
+        MBEDTLS_TLS1_3_CHACHA20_POLY1305_SHA256,
+#endif
+        MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256,
+        MBEDTLS_TLS_ECDHE_RSA_WITH_AES_256_GCM_SHA384,
+        0
+};
+
+static bool initPsa()
+{
+    // TLS 1.3 in mbedTLS 3.x does its crypto through PSA
+    static std::once_flag flag;
+    static bool initialized = false;
+    std::call_once(flag, [] { initialized = psa_crypto_init() == PSA_SUCCESS; });
+    return initialized;
+}
+
+TlsSession::TlsSession(int fd)
+    : mFd(fd)
+{
+    mbedtls_ssl_init(&mSsl);
+    mbedtls_ssl_config_init(&mConfig);
+    mbedtls_x509_crt_init(&mCertificate);
+    mbedtls_entropy_init(&mEntropy);
+    mbedtls_ctr_drbg_init(&mRandom);
+}
+
+TlsSession::~TlsSession()
+{
+    mbedtls_ssl_free(&mSsl);
+    mbedtls_ssl_config_free(&mConfig);
+    mbedtls_x509_crt_free(&mCertificate);
+    utils::crypto::freePkContext(mKey);
+    mbedtls_ctr_drbg_free(&mRandom);
+    mbedtls_entropy_free(&mEntropy);
+}
+
+TlsSession::UniquePointer TlsSession::make(Role role, const Transport::TlsConfig& config, int fd)
+{
+    UniquePointer session{new TlsSession{fd}};
+    if (!session->setup(role, config))
+        return {};
+    return session;
+}
+
+bool TlsSession::setup(Role role, const Transport::TlsConfig& config)
+{
+    if (!initPsa())
+        return false;
+
+    if (mbedtls_ctr_drbg_seed(&mRandom, mbedtls_entropy_func, &mEntropy, nullptr, 0) != 0)
+        return false;
+
+    if (mbedtls_x509_crt_parse_file(&mCertificate, config.certificatePath.c_str()) != 0)
+        return false;
+
+    mKey = utils::crypto::makePkContextFromPem(config.privateKeyPath);
+    if (!mKey)
+        return false;
+
+    int endpoint = role == CLIENT ? MBEDTLS_SSL_IS_CLIENT : MBEDTLS_SSL_IS_SERVER;
+    if (mbedtls_ssl_config_defaults(&mConfig, endpoint, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT) != 0)
+        return false;
+
+    // Devices present self-signed certificates, trust comes from the adb key they've authorized
+    mbedtls_ssl_conf_authmode(&mConfig, MBEDTLS_SSL_VERIFY_NONE);
+    mbedtls_ssl_conf_rng(&mConfig, mbedtls_ctr_drbg_random, &mRandom);
+    mbedtls_ssl_conf_ciphersuites(&mConfig, CIPHERSUITES);
+    if (mbedtls_ssl_conf_own_cert(&mConfig, &mCertificate, mKey) != 0)
+        return false;
+
+    if (mbedtls_ssl_setup(&mSsl, &mConfig) != 0)
+        return false;
+
+    mbedtls_ssl_set_bio(&mSsl, this, &TlsSession::sendCallback, &TlsSession::receiveCallback, nullptr);
+    return true;
+}
+
+bool TlsSession::handshake(std::chrono::milliseconds timeout)
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    while (true) {
+        int res = mbedtls_ssl_handshake(&mSsl);
+        if (res == 0)
+            return true;
+        if (res != MBEDTLS_ERR_SSL_WANT_READ && res != MBEDTLS_ERR_SSL_WANT_WRITE)
+            return false;
+
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (left.count() <= 0)
+            return false;
+
+        pollfd pollFd{mFd, static_cast<short>(res == MBEDTLS_ERR_SSL_WANT_READ ? POLLIN : POLLOUT), 0};
+        if (::poll(&pollFd, 1, static_cast<int>(left.count())) < 0 && errno != EINTR)
+            return false;
+    }
+}
+
+bool TlsSession::write(const uint8_t* data, size_t size)
+{
+    // mbedtls_ssl_write takes at most one record per call
+    while (size > 0) {
+        int res = mbedtls_ssl_write(&mSsl, data, size);
+        if (res == MBEDTLS_ERR_SSL_WANT_WRITE || res == MBEDTLS_ERR_SSL_WANT_READ)
+            continue;
+        if (res < 0)
+            return false;
+
+        data += res;
+        size -= res;
+    }
+    return true;
+}
+
+long TlsSession::read(uint8_t* data, size_t size)
+{
+    while (true) {
+        int res = mbedtls_ssl_read(&mSsl, data, size);
+        if (res > 0)
+            return res;
+        if (res == MBEDTLS_ERR_SSL_WANT_READ || res == MBEDTLS_ERR_SSL_WANT_WRITE)
+            return 0;
+#if defined(MBEDTLS_ERR_SSL_RECEIVED_NEW_SESSION_TICKET)
+        if (res == MBEDTLS_ERR_SSL_RECEIVED_NEW_SESSION_TICKET)
+            continue; // TLS 1.3 post-handshake message, the data may follow it
+#endif
+        return -1; // 0 is EOF, MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY or a failure
+    }
+}
+
+void TlsSession::closeNotify()
+{
+    mbedtls_ssl_close_notify(&mSsl);
+}
+
+size_t TlsSession::getBufferedSize() const
+{
+    return mbedtls_ssl_get_bytes_avail(&mSsl);
+}
+
+std::string TlsSession::getCiphersuite() const
+{
+    const char* name = mbedtls_ssl_get_ciphersuite(&mSsl);
+    return name ? name : "";
+}
+
+int TlsSession::sendCallback(void* context, const unsigned char* data, size_t size)
+{
+    auto* self = static_cast<TlsSession*>(context);
+    while (true) {
+        auto sent = ::send(self->mFd, data, size, SmartSocket::NO_SIGNAL);
+        if (sent >= 0)
+            return static_cast<int>(sent);
+        if (errno != EINTR)
+            return MBEDTLS_ERR_NET_SEND_FAILED;
+    }
+}
+
+int TlsSession::receiveCallback(void* context, unsigned char* data, size_t size)
+{
+    auto* self = static_cast<TlsSession*>(context);
+    while (true) {
+        auto received = ::recv(self->mFd, data, size, MSG_DONTWAIT);
+        if (received >= 0)
+            return static_cast<int>(received);
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return MBEDTLS_ERR_SSL_WANT_READ;
+        if (errno != EINTR)
+            return MBEDTLS_ERR_NET_RECV_FAILED;
+    }
+}
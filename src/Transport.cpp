@@ -1,6 +1,56 @@
 #include "Transport.hpp"
 
 #include <utility>
+#include <atomic>
+
+void Transport::send(APacket&& packet)
+{
+    send(std::move(packet), {});
+}
+
+std::future<Transport::ErrorCode> Transport::sendAsync(APacket&& packet)
+{
+    auto promise = std::make_shared<std::promise<ErrorCode>>();
+    auto future = promise->get_future();
+
+    send(std::move(packet), [promise] (const APacket*, ErrorCode errorCode) {
+        promise->set_value(errorCode);
+    });
+
+    return future;
+}
+
+std::future<Transport::ErrorCode> Transport::sendBatch(std::vector<APacket>&& packets)
+{
+    struct BatchState {
+        std::promise<ErrorCode> promise;
+        std::atomic<size_t> remaining;
+        std::atomic<int> firstError{OK};
+    };
+
+    auto state = std::make_shared<BatchState>();
+    state->remaining = packets.size();
+    auto future = state->promise.get_future();
+
+    if (packets.empty()) {
+        state->promise.set_value(OK);
+        return future;
+    }
+
+    for (auto& packet : packets) {
+        send(std::move(packet), [state] (const APacket*, ErrorCode errorCode) {
+            if (errorCode != OK) {
+                int expected = OK;
+                state->firstError.compare_exchange_strong(expected, errorCode);
+            }
+
+            if (--state->remaining == 0)
+                state->promise.set_value(static_cast<ErrorCode>(state->firstError.load()));
+        });
+    }
+
+    return future;
+}
 
 void Transport::setSendListener(Transport::Listener listener)
 {
@@ -17,9 +67,17 @@ void Transport::resetSendListener()
     mSendListener = {};
 }
 
+void Transport::setRawReceiveListener(Transport::RawListener listener, void* context)
+{
+    mRawReceiveListener = listener;
+    mRawReceiveContext = context;
+}
+
 void Transport::resetReceiveListener()
 {
     mReceiveListener = {};
+    mRawReceiveListener = nullptr;
+    mRawReceiveContext = nullptr;
 }
 
 void Transport::notifySendListener(const APacket* packet, ErrorCode errorCode)
@@ -28,12 +86,19 @@ void Transport::notifySendListener(const APacket* packet, ErrorCode errorCode)
         mSendListener(packet, errorCode);
 }
 
-void Transport::notifyReceiveListener(const APacket* packet, ErrorCode errorCode)
+void Transport::notifyReceiveListener(APacket* packet, ErrorCode errorCode)
 {
-    if(mReceiveListener)
+    if (mRawReceiveListener)
+        mRawReceiveListener(mRawReceiveContext, packet, errorCode);
+    else if(mReceiveListener)
         mReceiveListener(packet, errorCode);
 }
 
+bool Transport::startTls(const TlsConfig&)
+{
+    return false;
+}
+
 void Transport::setMaxPayloadSize(size_t maxPayloadSize) {
     mMaxPayloadSize = maxPayloadSize;
 }
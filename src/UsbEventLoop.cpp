@@ -0,0 +1,134 @@
+#include "UsbEventLoop.hpp"
+
+#include <iostream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+thread_local UsbEventLoop* UsbEventLoop::tCurrentLoop = nullptr;
+
+UsbEventLoop::BusyScope::BusyScope()
+    : mLoop(tCurrentLoop)
+{
+    if (mLoop)
+        mStart = Clock::now();
+}
+
+UsbEventLoop::BusyScope::~BusyScope()
+{
+    if (!mLoop)
+        return;
+
+    auto busy = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - mStart);
+    mLoop->mBusyNanoseconds.fetch_add(busy.count(), std::memory_order_relaxed);
+    mLoop->mCallbacks.fetch_add(1, std::memory_order_relaxed);
+}
+
+UsbEventLoop::UsbEventLoop(std::vector<int> cpuSet, Mode mode)
+    : mContext(ObjLibusbContext::make())
+    , mCpuSet(std::move(cpuSet))
+    , mMode(mode)
+    , mRunning(false)
+    , mBusyNanoseconds(0)
+    , mCallbacks(0)
+    , mLastSampleBusy(0)
+{}
+
+UsbEventLoop::~UsbEventLoop()
+{
+    stop();
+}
+
+void UsbEventLoop::start()
+{
+    if (mRunning.exchange(true))
+        return;
+
+    mStartTime = mLastSampleTime = Clock::now();
+    mThread = std::thread([this] { run(); });
+}
+
+void UsbEventLoop::stop()
+{
+    if (!mRunning.exchange(false))
+        return;
+
+    libusb_interrupt_event_handler(mContext->getRawContext());
+    if (mThread.joinable())
+        mThread.join();
+}
+
+void UsbEventLoop::run()
+{
+    tCurrentLoop = this;
+    if (!mCpuSet.empty() && !applyAffinity())
+        std::cerr << "[UsbEventLoop] couldn't pin the loop to the requested CPUs" << std::endl;
+
+    auto* context = mContext->getRawContext();
+    if (mMode == BUSY_POLL) {
+        timeval zero{0, 0};
+        while (mRunning.load(std::memory_order_relaxed))
+            libusb_handle_events_timeout_completed(context, &zero, nullptr);
+    }
+    else {
+        while (mRunning.load(std::memory_order_relaxed))
+            libusb_handle_events_completed(context, nullptr);
+    }
+
+    tCurrentLoop = nullptr;
+}
+
+bool UsbEventLoop::applyAffinity()
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : mCpuSet)
+        CPU_SET(cpu, &set);
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+const UsbEventLoop::SharedContext& UsbEventLoop::getContext() const
+{
+    return mContext;
+}
+
+bool UsbEventLoop::isRunning() const
+{
+    return mRunning;
+}
+
+UsbEventLoop::Mode UsbEventLoop::getMode() const
+{
+    return mMode;
+}
+
+UsbEventLoop::Stats UsbEventLoop::getStats() const
+{
+    uint64_t wall = 0;
+    if (mRunning)
+        wall = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - mStartTime).count();
+
+    return {mBusyNanoseconds.load(std::memory_order_relaxed),
+            wall,
+            mCallbacks.load(std::memory_order_relaxed)};
+}
+
+double UsbEventLoop::sampleUtilization()
+{
+    auto now = Clock::now();
+    auto busy = mBusyNanoseconds.load(std::memory_order_relaxed);
+    auto wall = std::chrono::duration_cast<std::chrono::nanoseconds>(now - mLastSampleTime).count();
+
+    double utilization = wall > 0 ? double(busy - mLastSampleBusy) / double(wall) : 0.0;
+    mLastSampleTime = now;
+    mLastSampleBusy = busy;
+    return utilization;
+}
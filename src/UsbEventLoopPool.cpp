@@ -0,0 +1,62 @@
+#include "UsbEventLoopPool.hpp"
+
+
+UsbEventLoopPool::UsbEventLoopPool(const Config& config)
+{
+    auto count = std::max<size_t>(config.loopCount, 1);
+    mLoops.reserve(count);
+
+    for (size_t i = 0; i < count; ++i) {
+        std::vector<int> cpuSet;
+        if (!config.cpuSets.empty())
+            cpuSet = config.cpuSets[i % config.cpuSets.size()];
+
+        mLoops.push_back(std::make_unique<UsbEventLoop>(std::move(cpuSet), config.mode));
+        mLoops.back()->start();
+    }
+}
+
+UsbEventLoopPool::SharedPointer UsbEventLoopPool::make(size_t loopCount)
+{
+    return make(Config{loopCount, {}, UsbEventLoop::BLOCKING});
+}
+
+UsbEventLoopPool::SharedPointer UsbEventLoopPool::make(Config config)
+{
+    return SharedPointer{new UsbEventLoopPool{config}};
+}
+
+UsbEventLoopPool::~UsbEventLoopPool()
+{
+    stop();
+}
+
+void UsbEventLoopPool::stop()
+{
+    for (auto& loop : mLoops)
+        loop->stop();
+}
+
+size_t UsbEventLoopPool::getLoopCount() const
+{
+    return mLoops.size();
+}
+
+UsbEventLoop& UsbEventLoopPool::getLoop(size_t index)
+{
+    return *mLoops.at(index);
+}
+
+size_t UsbEventLoopPool::shardOf(size_t hash) const
+{
+    return hash % mLoops.size();
+}
+
+std::vector<double> UsbEventLoopPool::sampleUtilization()
+{
+    std::vector<double> utilization;
+    utilization.reserve(mLoops.size());
+    for (auto& loop : mLoops)
+        utilization.push_back(loop->sampleUtilization());
+    return utilization;
+}
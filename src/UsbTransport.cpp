@@ -6,6 +6,8 @@
 
 #include <ObjLibusb/Error.hpp>
 
+#include "UsbEventLoop.hpp"
+
 
 UsbTransport::UsbTransport(const Device& device, const InterfaceData& interfaceData)
     : mDevice(device.referenceDevice())
@@ -147,13 +149,17 @@ bool UsbTransport::isOk() const
     return (mFlags & TRANSPORT_IS_OK) == TRANSPORT_IS_OK;
 }
 
-void UsbTransport::send(APacket&& packet)
+void UsbTransport::send(APacket&& packet, Completion completion)
 {
     std::scoped_lock lock(mSendMutex);
 
     static size_t transferId = 0;
-    auto [transfersIt, inserted] = mSendTransfers.emplace(++transferId, std::move(packet));
+    auto [transfersIt, inserted] = mSendTransfers.try_emplace(++transferId,
+                                                              std::move(packet),
+                                                              std::move(completion));
     if (!inserted) {
+        if (completion)
+            completion(nullptr, TRANSPORT_ERROR);
         finishSendTransfer(nullptr, mSendTransfers.end());
         return;
     }
@@ -180,6 +186,7 @@ void UsbTransport::send(APacket&& packet)
         std::cerr << "[UsbTransfer::send(...)] message transfer wasn't submitted, libusb_error: "
             << transfers.messageTransfer->getLastError() << std::endl;
         std::cerr << "[UsbTransfer::send(...)] packet transfer won't be completed" << std::endl;
+        transfers.errorCode = UNDERLYING_ERROR;
         finishSendTransfer(callbackData, transfersIt);
         return;
     }
@@ -208,6 +215,7 @@ void UsbTransport::send(APacket&& packet)
             std::cerr << "[UsbTransfer::send(...)] message transfer cancelled" << std::endl;
             messageLock.lock();
             transfers.messageTransfer->cancel(messageLock);
+            transfers.errorCode = UNDERLYING_ERROR;
             finishSendTransfer(callbackData, transfersIt);
         }
     }
@@ -228,6 +236,8 @@ void UsbTransport::receive()
 void UsbTransport::staticSendMessageCallback(const Transfer::SharedPointer& messageTransfer,
                                              const Transfer::UniqueLock& messageLock)
 {
+    UsbEventLoop::BusyScope busy;
+
     // GET ESSENTIAL DATA:
     auto callbackData = static_cast<CallbackData*>(messageTransfer->getUserData(messageLock));
     auto* transport = callbackData->transport;
@@ -255,6 +265,8 @@ void UsbTransport::staticSendMessageCallback(const Transfer::SharedPointer& mess
 void UsbTransport::staticSendPayloadCallback(const Transfer::SharedPointer& payloadTransfer,
                                              const Transfer::UniqueLock& payloadLock)
 {
+    UsbEventLoop::BusyScope busy;
+
     auto callbackData = static_cast<CallbackData*>(payloadTransfer->getUserData(payloadLock));
     auto* transport = callbackData->transport;
     auto transferId = callbackData->transferId;
@@ -279,6 +291,8 @@ void UsbTransport::staticSendPayloadCallback(const Transfer::SharedPointer& payl
 void UsbTransport::staticReceiveMessageCallback(const Transfer::SharedPointer& messageTransfer,
                                                 const Transfer::UniqueLock& messageLock)
 {
+    UsbEventLoop::BusyScope busy;
+
     // GET ESSENTIAL DATA:
     auto* transport = static_cast<UsbTransport*>(messageTransfer->getUserData(messageLock));
     auto& transferPack = transport->mReceiveTransferPack;
@@ -305,6 +319,8 @@ void UsbTransport::staticReceiveMessageCallback(const Transfer::SharedPointer& m
 void UsbTransport::staticReceivePayloadCallback(const Transfer::SharedPointer& payloadTransfer,
                                                 const Transfer::UniqueLock& payloadLock)
 {
+    UsbEventLoop::BusyScope busy;
+
     // GET ESSENTIAL DATA:
     auto* transport = static_cast<UsbTransport*>(payloadTransfer->getUserData(payloadLock));
     auto& transferPack = transport->mReceiveTransferPack;
@@ -394,7 +410,10 @@ void UsbTransport::finishSendTransfer(UsbTransport::CallbackData* callbackData,
     if (mapIterator == mSendTransfers.end())
         notifySendListener(nullptr, TRANSPORT_ERROR);
     else {
-        notifySendListener(&mapIterator->second.packet, mapIterator->second.errorCode);
+        auto& transferPack = mapIterator->second;
+        if (transferPack.completion)
+            transferPack.completion(&transferPack.packet, transferPack.errorCode);
+        notifySendListener(&transferPack.packet, transferPack.errorCode);
         mSendTransfers.erase(mapIterator);
     }
 }
@@ -0,0 +1,92 @@
+#include "WriteWindow.hpp"
+
+#include <algorithm>
+#include <utility>
+
+
+WriteWindow::SharedPointer WriteWindow::make(size_t maxInFlight, size_t bufferSize, size_t maxCached)
+{
+    return SharedPointer{new WriteWindow{std::max<size_t>(maxInFlight, 1), bufferSize, maxCached}};
+}
+
+WriteWindow::WriteWindow(size_t maxInFlight, size_t bufferSize, size_t maxCached)
+    : mMaxInFlight(maxInFlight)
+{
+    if (bufferSize > 0)
+        mPool.emplace(bufferSize, maxCached);
+}
+
+std::optional<Transport::Completion> WriteWindow::tryAcquire()
+{
+    std::unique_lock lock(mMutex);
+    if (mInFlight >= mMaxInFlight)
+        return std::nullopt;
+
+    if (++mInFlight == mMaxInFlight && mFullListener)
+        mFullListener(true);
+    lock.unlock();
+    return makeCompletion();
+}
+
+std::optional<Transport::Completion> WriteWindow::acquire()
+{
+    std::unique_lock lock(mMutex);
+    mReleased.wait(lock, [this] { return mInFlight < mMaxInFlight || mError != Transport::OK; });
+    if (mError != Transport::OK)
+        return std::nullopt;
+
+    if (++mInFlight == mMaxInFlight && mFullListener)
+        mFullListener(true);
+    lock.unlock();
+    return makeCompletion();
+}
+
+bool WriteWindow::waitForAll()
+{
+    std::unique_lock lock(mMutex);
+    mReleased.wait(lock, [this] { return mInFlight == 0; });
+    return mError == Transport::OK;
+}
+
+Transport::ErrorCode WriteWindow::getError() const
+{
+    std::scoped_lock lock(mMutex);
+    return mError;
+}
+
+Transport::ErrorCode WriteWindow::takeError()
+{
+    std::scoped_lock lock(mMutex);
+    return std::exchange(mError, Transport::OK);
+}
+
+void WriteWindow::setFullListener(FullListener listener)
+{
+    std::scoped_lock lock(mMutex);
+    mFullListener = std::move(listener);
+}
+
+PayloadPool& WriteWindow::getPool()
+{
+    return *mPool;
+}
+
+Transport::Completion WriteWindow::makeCompletion()
+{
+    return [self = shared_from_this()] (APacket* packet, Transport::ErrorCode errorCode) {
+        if (self->mPool && packet && packet->hasPayload())
+            self->mPool->release(packet->movePayloadOut());
+        self->release(errorCode);
+    };
+}
+
+void WriteWindow::release(Transport::ErrorCode errorCode)
+{
+    std::unique_lock lock(mMutex);
+    if (errorCode != Transport::OK && mError == Transport::OK)
+        mError = errorCode;
+    if (mInFlight-- == mMaxInFlight && mFullListener)
+        mFullListener(false);
+    lock.unlock();
+    mReleased.notify_all();
+}
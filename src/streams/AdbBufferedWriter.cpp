@@ -0,0 +1,150 @@
+#include "streams/AdbBufferedWriter.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+
+AdbBufferedWriter::State::State(AdbOStream ostream, size_t maxData, std::chrono::microseconds delay)
+    : ostream(std::move(ostream))
+    , delay(delay)
+    , window(WriteWindow::make(WriteWindow::UNLIMITED, maxData, 4))
+{}
+
+void AdbBufferedWriter::State::flushLocked()
+{
+    if (timer != TimerQueue::INVALID_ID) {
+        TimerQueue::shared().cancel(timer);
+        timer = TimerQueue::INVALID_ID;
+    }
+
+    if (!pending || pending->getSize() == 0)
+        return;
+
+    auto payload = std::move(*pending);
+    pending.reset();
+
+    // Completions may run inside write(), under mutex
+    ostream.write(std::move(payload), std::move(*window->tryAcquire()));
+}
+
+void AdbBufferedWriter::State::armTimer(const std::shared_ptr<State>& self)
+{
+    if (delay.count() == 0 || timer != TimerQueue::INVALID_ID || !pending || pending->getSize() == 0)
+        return;
+
+    // A timer cancelled too late still runs, it must not take over its successor. The id is set under
+    // the mutex, before the callback can look at it
+    std::weak_ptr<State> weak = self;
+    auto id = std::make_shared<TimerQueue::Id>();
+    timer = *id = TimerQueue::shared().schedule(delay, [weak, id] {
+        auto state = weak.lock();
+        if (!state)
+            return;
+
+        std::scoped_lock lock(state->mutex);
+        if (state->timer != *id)
+            return;
+        state->timer = TimerQueue::INVALID_ID;
+        if (state->reserved > 0)
+            state->armTimer(state); // the caller is formatting into the payload, try later
+        else
+            state->flushLocked();
+    });
+}
+
+AdbBufferedWriter::AdbBufferedWriter(AdbOStream ostream, size_t maxData, std::chrono::microseconds delay)
+    : mState(std::make_shared<State>(std::move(ostream), maxData, delay))
+{}
+
+AdbBufferedWriter::~AdbBufferedWriter()
+{
+    std::unique_lock lock(mState->mutex);
+    mState->reserved = 0;
+    mState->flushLocked();
+    lock.unlock();
+
+    // Dropping the last handle to the stream would drop its queued writes too
+    mState->window->waitForAll();
+}
+
+AdbBufferedWriter& AdbBufferedWriter::write(const void* data, size_t size)
+{
+    auto* bytes = static_cast<const uint8_t*>(data);
+    auto capacity = mState->window->getPool().getBufferSize();
+
+    std::scoped_lock lock(mState->mutex);
+    while (size > 0) {
+        if (!mState->pending)
+            mState->pending = mState->window->getPool().acquire();
+
+        auto& payload = *mState->pending;
+        auto used = payload.getSize();
+        auto count = std::min(size, capacity - used);
+        std::memcpy(payload.getBuffer() + used, bytes, count);
+        payload.setDataSize(used + count);
+        bytes += count;
+        size -= count;
+
+        if (payload.getSize() == capacity)
+            mState->flushLocked();
+    }
+
+    mState->armTimer(mState);
+    return *this;
+}
+
+AdbBufferedWriter& AdbBufferedWriter::operator<<(std::string_view string)
+{
+    return write(string.data(), string.size());
+}
+
+uint8_t* AdbBufferedWriter::reserve(size_t size)
+{
+    auto capacity = mState->window->getPool().getBufferSize();
+    if (size > capacity)
+        return nullptr;
+
+    std::scoped_lock lock(mState->mutex);
+    if (mState->pending && mState->pending->getSize() + size > capacity)
+        mState->flushLocked();
+    if (!mState->pending)
+        mState->pending = mState->window->getPool().acquire();
+
+    mState->reserved = size;
+    return mState->pending->getBuffer() + mState->pending->getSize();
+}
+
+void AdbBufferedWriter::commit(size_t size)
+{
+    std::scoped_lock lock(mState->mutex);
+    if (!mState->pending)
+        return;
+
+    auto& payload = *mState->pending;
+    payload.setDataSize(payload.getSize() + std::min(size, mState->reserved));
+    mState->reserved = 0;
+
+    if (payload.getSize() == mState->window->getPool().getBufferSize())
+        mState->flushLocked();
+    else
+        mState->armTimer(mState);
+}
+
+void AdbBufferedWriter::flush()
+{
+    std::scoped_lock lock(mState->mutex);
+    mState->flushLocked();
+}
+
+size_t AdbBufferedWriter::getPendingSize() const
+{
+    std::scoped_lock lock(mState->mutex);
+    return mState->pending ? mState->pending->getSize() : 0;
+}
+
+bool AdbBufferedWriter::isOpen()
+{
+    std::scoped_lock lock(mState->mutex);
+    return mState->ostream.isOpen();
+}
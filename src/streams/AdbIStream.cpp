@@ -1,5 +1,7 @@
 #include "streams/AdbIStream.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include <utility>
 #include "APayload.hpp"
 
@@ -10,16 +12,62 @@ AdbIStream::AdbIStream(std::shared_ptr<AdbStreamBase> basePtr)
 
 AdbIStream& AdbIStream::operator>>(std::string &string)
 {
-    string = std::move(mBasePtr->getPayload().toString());
+    string = next().toString();
     return *this;
 }
 
 AdbIStream& AdbIStream::operator>> (APayload& payload)
 {
-    payload = std::move(mBasePtr->getPayload());
+    payload = next();
     return *this;
 }
 
+std::optional<APayload> AdbIStream::tryRead()
+{
+    if (mLeftover)
+        return next();
+    return mBasePtr->tryGetPayload();
+}
+
+std::optional<APayload> AdbIStream::readFor(std::chrono::nanoseconds timeout)
+{
+    if (mLeftover)
+        return next();
+    return mBasePtr->getPayloadFor(timeout);
+}
+
+size_t AdbIStream::readInto(void* buffer, size_t size)
+{
+    if (!mLeftover) {
+        auto payload = mBasePtr->getPayload();
+        if (payload.getSize() == 0) // closed
+            return 0;
+        mLeftover = std::move(payload);
+        mLeftoverOffset = 0;
+    }
+
+    auto count = std::min(size, mLeftover->getSize() - mLeftoverOffset);
+    std::memcpy(buffer, mLeftover->getBuffer() + mLeftoverOffset, count);
+    mLeftoverOffset += count;
+    if (mLeftoverOffset == mLeftover->getSize())
+        mLeftover.reset();
+    return count;
+}
+
+APayload AdbIStream::next()
+{
+    if (!mLeftover)
+        return mBasePtr->getPayload();
+
+    // Unread tail moves to the front of the same buffer, no allocation
+    auto payload = std::move(*mLeftover);
+    mLeftover.reset();
+    auto size = payload.getSize() - mLeftoverOffset;
+    std::memmove(payload.getBuffer(), payload.getBuffer() + mLeftoverOffset, size);
+    payload.setDataSize(size);
+    return payload;
+}
+
 bool AdbIStream::isOpen() const
 {
     return mBasePtr && mBasePtr->isOpen();
@@ -27,10 +75,37 @@ bool AdbIStream::isOpen() const
 
 void AdbIStream::close()
 {
+    mLeftover.reset();
     mBasePtr.reset();
 }
 
 bool AdbIStream::isEmpty() const
 {
-    return mBasePtr->mIncomingQueue.empty();
+    return !mLeftover && (!mBasePtr || mBasePtr->mIncoming.isEmpty());
+}
+
+void AdbIStream::setSpinBeforePark(std::chrono::nanoseconds duration)
+{
+    mBasePtr->setSpinBeforePark(duration);
+}
+
+void AdbIStream::setWatermarks(AdbStreamBase::Watermarks watermarks)
+{
+    mBasePtr->setWatermarks(watermarks);
+}
+
+void AdbIStream::setAckOnRead(bool ackOnRead)
+{
+    mBasePtr->setWatermarks(ackOnRead ? AdbStreamBase::ACK_ON_READ : AdbStreamBase::UNBOUNDED);
+}
+
+void AdbIStream::setDataListener(AdbStreamBase::DataListener listener)
+{
+    if (mBasePtr) // closed by the caller, nothing would call it anymore
+        mBasePtr->setDataListener(std::move(listener));
+}
+
+void AdbIStream::setHandlers(AdbStreamBase::Handlers handlers)
+{
+    mBasePtr->setHandlers(std::move(handlers));
 }
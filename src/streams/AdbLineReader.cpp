@@ -0,0 +1,62 @@
+#include "streams/AdbLineReader.hpp"
+
+#include <cstring>
+
+
+AdbLineReader::AdbLineReader(AdbIStream& stream, char delimiter, bool trimCarriageReturn)
+    : mStream(stream)
+    , mDelimiter(delimiter)
+    , mTrimCarriageReturn(trimCarriageReturn && delimiter != '\r')
+{}
+
+std::optional<std::string_view> AdbLineReader::next()
+{
+    if (mSpanningReturned) {
+        mSpanning.clear(); // keeps the capacity
+        mSpanningReturned = false;
+    }
+
+    while (true) {
+        if (mPayload) {
+            auto* begin = reinterpret_cast<const char*>(mPayload->getBuffer()) + mOffset;
+            auto left = mPayload->getSize() - mOffset;
+            auto* found = static_cast<const char*>(std::memchr(begin, mDelimiter, left));
+
+            if (found) {
+                auto length = static_cast<size_t>(found - begin);
+                mOffset += length + 1;
+                if (mSpanning.empty())
+                    return trim({begin, length}); // the common case: a view into the payload
+
+                mSpanning.append(begin, length);
+                mSpanningReturned = true;
+                return trim(mSpanning);
+            }
+
+            // The record goes on in the next payload
+            mSpanning.append(begin, left);
+            mPayload.reset();
+        }
+
+        APayload payload{0};
+        mStream >> payload;
+        if (payload.getSize() == 0) // closed and drained
+            break;
+
+        mPayload = std::move(payload);
+        mOffset = 0;
+    }
+
+    if (mSpanning.empty())
+        return std::nullopt;
+
+    mSpanningReturned = true;
+    return trim(mSpanning);
+}
+
+std::string_view AdbLineReader::trim(std::string_view record) const
+{
+    if (mTrimCarriageReturn && !record.empty() && record.back() == '\r')
+        record.remove_suffix(1);
+    return record;
+}
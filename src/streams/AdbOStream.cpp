@@ -13,6 +13,27 @@ AdbOStream& AdbOStream::operator<<(APayload payload)
     return *this;
 }
 
+AdbOStream& AdbOStream::write(APayload payload, Transport::Completion completion)
+{
+    if (mBasePtr)
+        mBasePtr->send(std::move(payload), std::move(completion));
+    else if (completion)
+        completion(nullptr, Transport::CANCELLED);
+    return *this;
+}
+
+std::future<Transport::ErrorCode> AdbOStream::writeAsync(APayload payload)
+{
+    auto promise = std::make_shared<std::promise<Transport::ErrorCode>>();
+    auto future = promise->get_future();
+
+    write(std::move(payload), [promise] (const APacket*, Transport::ErrorCode errorCode) {
+        promise->set_value(errorCode);
+    });
+
+    return future;
+}
+
 AdbOStream& AdbOStream::operator<<(const std::string_view& string)
 {
     if (mBasePtr)
@@ -1,17 +1,50 @@
 #include "streams/AdbStreamBase.hpp"
 #include "AdbDevice.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <utility>
 
-AdbStreamBase::AdbStreamBase(std::weak_ptr<AdbDevice> pointer, uint32_t localId, uint32_t remoteId)
+
+AdbStreamBase::AdbStreamBase(std::weak_ptr<AdbDevice> pointer, uint32_t localId, uint32_t remoteId, Watermarks watermarks)
     : mDevice(std::move(pointer))
     , mIsOpen(true)
     , mLocalId(localId)
     , mRemoteId(remoteId)
+    , mReadyToSend(true) // the device can take a WRTE right after OKAY to our OPEN
+    , mIncoming(INCOMING_CAPACITY)
+    , mSpinDuration(0)
+    , mQueuedBytes(0)
+    , mHighWatermark(watermarks.high)
+    , mLowWatermark(std::min(watermarks.low, watermarks.high))
+    , mAckOwed(false)
+    , mHasCallbacks(false)
+    , mDraining(false)
 {}
 
 void AdbStreamBase::close()
 {
+    std::unique_lock lock(mIncomingMutex);
     mIsOpen = false;
+    auto handlers = std::move(mHandlers); // the handlers may hold the stream, the cycle breaks here
+    mHandlers.reset();
+    lock.unlock();
+    mParker.notifyAll(); // wake up readers
+    notifyDataListener();
+
+    // Queued writes won't get an OKAY anymore
+    std::unique_lock outgoingLock(mOutgoingMutex);
+    auto outgoing = std::move(mOutgoingQueue);
+    mOutgoingQueue.clear();
+    outgoingLock.unlock();
+
+    for (auto& entry : outgoing)
+        if (entry.completion)
+            entry.completion(nullptr, Transport::CANCELLED);
+
+    if (handlers && handlers->onClose)
+        handlers->onClose();
 }
 
 bool AdbStreamBase::isOpen() const
@@ -19,43 +52,232 @@ bool AdbStreamBase::isOpen() const
     return mIsOpen && !mDevice.expired();
 }
 
-void AdbStreamBase::received(const APayload& payload)
+bool AdbStreamBase::received(APayload&& payload)
 {
     if (!isOpen())
+        return false;
+
+    if (!mHasCallbacks.load(std::memory_order_acquire)) {
+        bool acknowledge = enqueue(std::move(payload));
+        mParker.notifyAll();
+        return acknowledge;
+    }
+
+    std::unique_lock lock(mIncomingMutex);
+    if (mHandlers && mHandlers->onData && !mDraining) {
+        if (mIncoming.isEmpty()) {
+            // Reactor mode: no queue, no wake-ups. The device sends the next one once the handler is done
+            auto handlers = mHandlers;
+            lock.unlock();
+            handlers->onData(std::move(payload));
+            return true;
+        }
+
+        // Older payloads are still queued, they go first
+        bool acknowledge = enqueue(std::move(payload));
+        drainToHandlers(lock);
+        return acknowledge;
+    }
+
+    bool acknowledge = enqueue(std::move(payload));
+    auto listener = mDataListener;
+    lock.unlock();
+    mParker.notifyAll();
+    if (listener)
+        listener();
+    return acknowledge;
+}
+
+bool AdbStreamBase::enqueue(APayload&& payload)
+{
+    auto size = payload.getSize();
+    if (!mIncoming.tryPush(std::move(payload))) {
+        // Can't happen while the device waits for OKAY, which is held back once the ring is full
+        std::cerr << "AdbStreamBase: WRTE past a withheld OKAY, payload dropped" << std::endl;
+        return false;
+    }
+
+    auto queued = mQueuedBytes.fetch_add(size) + size;
+    if (queued < mHighWatermark.load(std::memory_order_relaxed) && mIncoming.getSize() < mIncoming.getCapacity())
+        return true;
+
+    // The reader pays it back, see popFront(). It might have drained the queue before seeing the debt
+    mAckOwed.store(true);
+    bool drained = mQueuedBytes.load() <= mLowWatermark.load(std::memory_order_relaxed)
+                   && mIncoming.getSize() < mIncoming.getCapacity();
+    return drained && mAckOwed.exchange(false);
+}
+
+void AdbStreamBase::setDataListener(DataListener listener)
+{
+    std::scoped_lock lock(mIncomingMutex);
+    mDataListener = std::move(listener);
+    mHasCallbacks = mDataListener || mHandlers;
+}
+
+void AdbStreamBase::setHandlers(Handlers handlers)
+{
+    std::unique_lock lock(mIncomingMutex);
+    mHandlers = std::make_shared<const Handlers>(std::move(handlers));
+    mHasCallbacks = true;
+    drainToHandlers(lock);
+
+    if (mIsOpen || !mHandlers)
         return;
 
+    // Closed before the handlers came
+    auto closed = std::move(mHandlers);
+    mHandlers.reset();
+    lock.unlock();
+    if (closed->onClose)
+        closed->onClose();
+}
+
+void AdbStreamBase::drainToHandlers(std::unique_lock<std::mutex>& lock)
+{
+    if (mDraining) // the call in progress hands the rest over
+        return;
+
+    // In order: payloads that come meanwhile queue up behind, see received()
+    mDraining = true;
+    while (mHandlers && mHandlers->onData) {
+        auto handlers = mHandlers;
+        lock.unlock();
+
+        auto payload = popFront();
+        if (payload)
+            handlers->onData(std::move(*payload));
+
+        lock.lock();
+        if (!payload && mIncoming.isEmpty()) // the producer pushes under the lock in this mode
+            break;
+    }
+    mDraining = false;
+}
+
+std::shared_ptr<const AdbStreamBase::Handlers> AdbStreamBase::getHandlers()
+{
+    std::scoped_lock lock(mIncomingMutex);
+    return mHandlers;
+}
+
+void AdbStreamBase::notifyDataListener()
+{
     std::unique_lock lock(mIncomingMutex);
-    mIncomingQueue.push_back(payload);
+    if (!mDataListener)
+        return;
+    auto listener = mDataListener;
     lock.unlock();
-    mReceived.notify_one();
+    listener();
+}
+
+void AdbStreamBase::spinForData()
+{
+    if (mSpinDuration.count() == 0 || !mIncoming.isEmpty())
+        return;
+
+    // Low-latency mode: spin for a fixed time on top of the parker's adaptive spin
+    auto deadline = std::chrono::steady_clock::now() + mSpinDuration;
+    while (mIncoming.isEmpty() && mIsOpen && std::chrono::steady_clock::now() < deadline)
+        ;
+}
+
+bool AdbStreamBase::waitForData(Parker::Clock::time_point deadline)
+{
+    spinForData();
+    return mParker.wait([this] { return !mIncoming.isEmpty() || !isOpen(); }, deadline);
 }
 
 APayload AdbStreamBase::getPayload()
 {
-    std::unique_lock lock(mIncomingMutex);
-    if (isOpen() && mIncomingQueue.empty())
-        mReceived.wait(lock, [this] {return !mIncomingQueue.empty();});
-    else if (!isOpen())
-        return APayload{0};
+    while (true) {
+        bool open = isOpen(); // checked first: a payload pushed before the close is still read
+        if (auto payload = popFront())
+            return std::move(*payload);
+        if (!open)
+            return APayload{0};
+
+        waitForData(Parker::Clock::time_point::max());
+    }
+}
+
+std::optional<APayload> AdbStreamBase::getPayloadFor(std::chrono::nanoseconds timeout)
+{
+    auto deadline = Parker::Clock::now() + std::chrono::duration_cast<Parker::Clock::duration>(timeout);
+    while (true) {
+        bool open = isOpen();
+        if (auto payload = popFront())
+            return payload;
+        if (!open || !waitForData(deadline))
+            return popFront();
+    }
+}
+
+std::optional<APayload> AdbStreamBase::tryGetPayload()
+{
+    if (mIncoming.isEmpty())
+        return std::nullopt;
+    return popFront();
+}
 
-    auto payload = std::move(mIncomingQueue.front());
-    mIncomingQueue.pop_front();
+std::optional<APayload> AdbStreamBase::popFront()
+{
+    std::unique_lock lock(mConsumerMutex);
+    auto payload = mIncoming.tryPop();
+    lock.unlock();
+    if (!payload)
+        return std::nullopt;
+
+    auto queued = mQueuedBytes.fetch_sub(payload->getSize()) - payload->getSize();
+    if (queued <= mLowWatermark.load(std::memory_order_relaxed) && mAckOwed.load() && mAckOwed.exchange(false)) {
+        auto device = lockDeviceIfOpen();
+        if (device)
+            device->acknowledge(mLocalId, mRemoteId);
+    }
     return payload;
 }
 
-void AdbStreamBase::send(APayload&& payload)
+void AdbStreamBase::setSpinBeforePark(std::chrono::nanoseconds duration)
+{
+    mSpinDuration = duration;
+}
+
+void AdbStreamBase::setWatermarks(Watermarks watermarks)
 {
+    mHighWatermark = watermarks.high;
+    mLowWatermark = std::min(watermarks.low, watermarks.high);
+
+    // Raised limits may release the device right away
+    auto queued = mQueuedBytes.load();
+    bool below = queued <= mLowWatermark || queued < mHighWatermark;
+    if (!below || mIncoming.getSize() >= mIncoming.getCapacity() || !mAckOwed.exchange(false))
+        return;
+
     auto device = lockDeviceIfOpen();
-    if (!device)
+    if (device)
+        device->acknowledge(mLocalId, mRemoteId);
+}
+
+void AdbStreamBase::send(APayload&& payload, Transport::Completion completion)
+{
+    auto device = lockDeviceIfOpen();
+    if (!device) {
+        if (completion)
+            completion(nullptr, Transport::CANCELLED);
         return;
+    }
 
     std::unique_lock lock(mOutgoingMutex);
-    if (mReadyToSend && mOutgoingQueue.empty()) {
+    if (mReadyToSend && mOutgoingQueue.empty() && payload.getSize() <= device->getMaxData()) {
         mReadyToSend = false;
-        device->send(mLocalId, mRemoteId, std::move(payload));
+        device->send(mLocalId, mRemoteId, std::move(payload), std::move(completion));
+        return;
     }
-    else {
-        mOutgoingQueue.emplace_back(std::move(payload));
+
+    mOutgoingQueue.push_back({std::move(payload), std::move(completion)});
+    if (mReadyToSend) {
+        mReadyToSend = false;
+        sendFront(device);
     }
 }
 
@@ -67,13 +289,56 @@ void AdbStreamBase::readyToSend()
 
     std::unique_lock lock(mOutgoingMutex);
     if (!mOutgoingQueue.empty()) {
-        device->send(mLocalId, mRemoteId, std::move(mOutgoingQueue.front()));
-        mOutgoingQueue.pop_front();
         mReadyToSend = false;
+        sendFront(device);
+        return;
+    }
+
+    mReadyToSend = true;
+    lock.unlock();
+
+    auto handlers = getHandlers();
+    if (handlers && handlers->onWritable)
+        handlers->onWritable();
+}
+
+void AdbStreamBase::sendFront(const SharedDevice& device)
+{
+    auto& outgoing = mOutgoingQueue.front();
+    size_t maxData = device->getMaxData();
+    size_t left = outgoing.payload.getSize() - outgoing.offset;
+
+    if (left > maxData) {
+        // Transport needs a payload of its own: the chunk is copied into a buffer reused chunk after chunk
+        if (!mChunks || mChunks->getPool().getBufferSize() != maxData)
+            mChunks = WriteWindow::make(WriteWindow::UNLIMITED, maxData, 2);
+
+        auto chunk = mChunks->getPool().acquire();
+        std::memcpy(chunk.getBuffer(), outgoing.payload.getBuffer() + outgoing.offset, maxData);
+        chunk.setDataSize(maxData);
+        outgoing.offset += maxData;
+
+        device->send(mLocalId, mRemoteId, std::move(chunk), std::move(*mChunks->tryAcquire()));
+        return;
+    }
+
+    // The last chunk: the tail moves to the front of the caller's own buffer
+    auto payload = std::move(outgoing.payload);
+    if (outgoing.offset > 0) {
+        std::memmove(payload.getBuffer(), payload.getBuffer() + outgoing.offset, left);
+        payload.setDataSize(left);
     }
-    else {
-        mReadyToSend = true;
+
+    auto completion = std::move(outgoing.completion);
+    auto chunkError = outgoing.offset > 0 ? mChunks->takeError() : Transport::OK;
+    mOutgoingQueue.pop_front();
+
+    if (chunkError != Transport::OK && completion) {
+        completion = [completion = std::move(completion), chunkError] (APacket* packet, Transport::ErrorCode) {
+            completion(packet, chunkError);
+        };
     }
+    device->send(mLocalId, mRemoteId, std::move(payload), std::move(completion));
 }
 
 AdbStreamBase::SharedDevice AdbStreamBase::lockDeviceIfOpen()
@@ -87,5 +352,5 @@ AdbStreamBase::~AdbStreamBase()
 {
     auto device = mDevice.lock();
     if (device)
-        device->closeStream(mLocalId);
+        device->closeStream(mLocalId, mRemoteId);
 }
\ No newline at end of file
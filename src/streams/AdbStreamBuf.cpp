@@ -0,0 +1,99 @@
+#include "streams/AdbStreamBuf.hpp"
+
+#include <utility>
+
+
+AdbStreamBuf::AdbStreamBuf(AdbIStream istream, AdbOStream ostream, size_t chunkSize, size_t maxInFlight)
+    : mIStream(std::move(istream))
+    , mOStream(std::move(ostream))
+    , mWindow(WriteWindow::make(maxInFlight, chunkSize))
+{
+    setg(nullptr, nullptr, nullptr);
+    setp(nullptr, nullptr); // the put area is taken on the first write
+}
+
+AdbStreamBuf::~AdbStreamBuf()
+{
+    sync();
+}
+
+bool AdbStreamBuf::isOpen() const
+{
+    return mIStream.isOpen();
+}
+
+AdbStreamBuf::int_type AdbStreamBuf::underflow()
+{
+    if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+
+    // The payload becomes the get area, the previous one is released
+    APayload payload(0);
+    mIStream >> payload;
+    if (payload.getSize() == 0) { // closed
+        mGetPayload.reset();
+        setg(nullptr, nullptr, nullptr);
+        return traits_type::eof();
+    }
+
+    mGetPayload = std::move(payload);
+    auto* begin = reinterpret_cast<char*>(mGetPayload->getBuffer());
+    setg(begin, begin, begin + mGetPayload->getSize());
+    return traits_type::to_int_type(*gptr());
+}
+
+AdbStreamBuf::int_type AdbStreamBuf::overflow(int_type ch)
+{
+    if (!flushPutArea())
+        return traits_type::eof();
+
+    if (!mPutPayload)
+        resetPutArea();
+
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+int AdbStreamBuf::sync()
+{
+    if (!flushPutArea())
+        return -1;
+
+    // Everything written so far has to reach the transport, a closed stream cancels its queue
+    return mWindow->waitForAll() ? 0 : -1;
+}
+
+std::streamsize AdbStreamBuf::showmanyc()
+{
+    if (!mIStream.isEmpty())
+        return 1; // at least a byte, payloads are never empty
+    return mIStream.isOpen() ? 0 : -1;
+}
+
+bool AdbStreamBuf::flushPutArea()
+{
+    if (!mPutPayload || pptr() == pbase())
+        return mWindow->getError() == Transport::OK;
+
+    auto completion = mWindow->acquire();
+    if (!completion)
+        return false;
+
+    auto payload = std::move(*mPutPayload);
+    payload.setDataSize(pptr() - pbase());
+    mPutPayload.reset();
+    setp(nullptr, nullptr);
+
+    mOStream.write(std::move(payload), std::move(*completion));
+    return true;
+}
+
+void AdbStreamBuf::resetPutArea()
+{
+    mPutPayload = mWindow->getPool().acquire();
+    auto* begin = reinterpret_cast<char*>(mPutPayload->getBuffer());
+    setp(begin, begin + mWindow->getPool().getBufferSize());
+}
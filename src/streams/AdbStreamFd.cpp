@@ -0,0 +1,120 @@
+#include "streams/AdbStreamFd.hpp"
+
+#include <cstdint>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+
+AdbStreamFd::State::State(int readFd, int writeFd)
+    : readFd(readFd)
+    , writeFd(writeFd)
+{}
+
+AdbStreamFd::State::~State()
+{
+    ::close(readFd);
+    ::close(writeFd);
+}
+
+void AdbStreamFd::State::signal(int fd)
+{
+    uint64_t one = 1;
+    [[maybe_unused]] auto written = ::write(fd, &one, sizeof(one));
+}
+
+void AdbStreamFd::State::clear(int fd)
+{
+    uint64_t count;
+    [[maybe_unused]] auto read = ::read(fd, &count, sizeof(count));
+}
+
+AdbStreamFd::UniquePointer AdbStreamFd::make(AdbDevice::Streams streams, size_t maxInFlight)
+{
+    int readFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int writeFd = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC); // writable from the start
+    if (readFd < 0 || writeFd < 0) {
+        if (readFd >= 0)
+            ::close(readFd);
+        if (writeFd >= 0)
+            ::close(writeFd);
+        return nullptr;
+    }
+
+    auto state = std::make_shared<State>(readFd, writeFd);
+    return UniquePointer{new AdbStreamFd(std::move(streams), std::move(state), maxInFlight)};
+}
+
+AdbStreamFd::AdbStreamFd(AdbDevice::Streams&& streams, std::shared_ptr<State> state, size_t maxInFlight)
+    : mStreams(std::move(streams))
+    , mState(std::move(state))
+    , mWindow(WriteWindow::make(maxInFlight))
+{
+    mWindow->setFullListener([state = mState] (bool full) {
+        if (full)
+            state->clear(state->writeFd);
+        else
+            state->signal(state->writeFd);
+    });
+
+    std::weak_ptr<State> weak = mState;
+    mStreams.istream.setDataListener([weak] {
+        if (auto state = weak.lock())
+            state->signal(state->readFd);
+    });
+    updateReadFd(); // the device may have written before the listener was set
+}
+
+AdbStreamFd::~AdbStreamFd()
+{
+    mStreams.istream.setDataListener({});
+}
+
+int AdbStreamFd::getReadFd() const
+{
+    return mState->readFd;
+}
+
+int AdbStreamFd::getWriteFd() const
+{
+    return mState->writeFd;
+}
+
+std::optional<APayload> AdbStreamFd::tryRead()
+{
+    auto payload = mStreams.istream.tryRead();
+    if (!payload || mStreams.istream.isEmpty())
+        updateReadFd();
+    return payload;
+}
+
+void AdbStreamFd::updateReadFd()
+{
+    if (!mStreams.istream.isOpen()) { // stays readable, like POLLHUP
+        mState->signal(mState->readFd);
+        return;
+    }
+
+    // A payload may come between the two calls, its listener signals after the clear then
+    mState->clear(mState->readFd);
+    if (!mStreams.istream.isEmpty())
+        mState->signal(mState->readFd);
+}
+
+bool AdbStreamFd::tryWrite(APayload payload)
+{
+    if (!mStreams.ostream.isOpen())
+        return false;
+
+    auto completion = mWindow->tryAcquire();
+    if (!completion)
+        return false;
+
+    // Closing the stream cancels queued writes, so a full window always opens up again
+    mStreams.ostream.write(std::move(payload), std::move(*completion));
+    return true;
+}
+
+bool AdbStreamFd::isOpen() const
+{
+    return mStreams.istream.isOpen();
+}
@@ -0,0 +1,106 @@
+#include "streams/AdbStreamPoller.hpp"
+
+
+AdbStreamPoller::AdbStreamPoller()
+    : mSignals(std::make_shared<Signals>())
+{}
+
+AdbStreamPoller::~AdbStreamPoller()
+{
+    std::unique_lock lock(mSignals->mutex);
+    auto streams = std::move(mStreams);
+    lock.unlock();
+
+    for (auto& [key, stream] : streams)
+        stream->setDataListener({});
+}
+
+bool AdbStreamPoller::add(AdbIStream& stream, Key key)
+{
+    std::unique_lock lock(mSignals->mutex);
+    if (!mStreams.emplace(key, &stream).second)
+        return false;
+    mSignals->signalled.insert(key); // might be ready already, wait() checks
+    lock.unlock();
+
+    std::weak_ptr<Signals> weak = mSignals;
+    stream.setDataListener([weak, key] {
+        auto signals = weak.lock();
+        if (!signals)
+            return;
+
+        std::unique_lock lock(signals->mutex);
+        signals->signalled.insert(key);
+        lock.unlock();
+        signals->changed.notify_one();
+    });
+    return true;
+}
+
+bool AdbStreamPoller::remove(Key key)
+{
+    std::unique_lock lock(mSignals->mutex);
+    auto it = mStreams.find(key);
+    if (it == mStreams.end())
+        return false;
+
+    auto* stream = it->second;
+    mStreams.erase(it);
+    mSignals->signalled.erase(key);
+    lock.unlock();
+
+    stream->setDataListener({});
+    return true;
+}
+
+size_t AdbStreamPoller::size() const
+{
+    std::scoped_lock lock(mSignals->mutex);
+    return mStreams.size();
+}
+
+std::vector<AdbStreamPoller::Key> AdbStreamPoller::wait(std::chrono::milliseconds timeout)
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::unique_lock lock(mSignals->mutex);
+    return collect([&] (auto&& ready) { return mSignals->changed.wait_until(lock, deadline, ready); });
+}
+
+std::vector<AdbStreamPoller::Key> AdbStreamPoller::wait()
+{
+    std::unique_lock lock(mSignals->mutex);
+    return collect([&] (auto&& ready) { mSignals->changed.wait(lock, ready); return true; });
+}
+
+bool AdbStreamPoller::isReady(const AdbIStream& stream)
+{
+    return !stream.isOpen() || !stream.isEmpty();
+}
+
+template<class Wait>
+std::vector<AdbStreamPoller::Key> AdbStreamPoller::collect(Wait&& wait)
+{
+    auto& signalled = mSignals->signalled;
+
+    // Level-triggered: streams the caller hasn't drained stay ready without a new signal
+    for (auto key : mLastReady)
+        signalled.insert(key);
+    mLastReady.clear();
+
+    std::vector<Key> ready;
+    while (ready.empty()) {
+        if (!wait([&] { return !signalled.empty(); }))
+            break; // timed out
+
+        // Signals may be stale: the data was read before the wait
+        for (auto key : signalled) {
+            auto it = mStreams.find(key);
+            if (it != mStreams.end() && isReady(*it->second))
+                ready.push_back(key);
+        }
+        signalled.clear();
+    }
+
+    mLastReady = ready;
+    return ready;
+}
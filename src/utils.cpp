@@ -84,6 +84,19 @@ mbedtls_pk_context* utils::crypto::makePkContextFromPem(const std::string& filep
     mbedtls_pk_init(ctx);
 
     int res = mbedtls_pk_parse_keyfile(ctx, filepath.c_str(), nullptr, generateRandomBytes, nullptr);
+    if (res != 0) {
+        freePkContext(ctx);
+        return nullptr;
+    }
+
+    return ctx;
+}
+
+void utils::crypto::freePkContext(mbedtls_pk_context* ctx)
+{
+    if (!ctx)
+        return;
 
-    return (res == 0) ? ctx : nullptr;
+    mbedtls_pk_free(ctx);
+    delete ctx;
 }
@@ -0,0 +1,91 @@
+#include <DeviceManager.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+// Round trip latency of 1-byte writes echoed back by `cat` on the device.
+// Compares blocking event loops with busy-poll loops + spinning readers.
+
+using Clock = std::chrono::steady_clock;
+
+static std::vector<double> measure(AdbDevice& device, size_t iterations, std::chrono::nanoseconds spin)
+{
+    std::vector<double> samples;
+    auto streams = device.open("shell,raw:cat");
+    if (!streams)
+        return samples;
+
+    auto& in = streams->istream;
+    auto& out = streams->ostream;
+    in.setSpinBeforePark(spin);
+    samples.reserve(iterations);
+
+    for (size_t i = 0; i < iterations + 10; ++i) {
+        APayload payload(1);
+        payload.setDataSize(1);
+        payload[0] = 'x';
+
+        auto start = Clock::now();
+        out << std::move(payload);
+        APayload echo(0);
+        in >> echo;
+        auto end = Clock::now();
+
+        if (i >= 10) // warm-up
+            samples.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+    }
+
+    std::sort(samples.begin(), samples.end());
+    return samples;
+}
+
+static void report(const std::string& name, const std::vector<double>& samples)
+{
+    if (samples.empty()) {
+        std::cout << name << ": couldn't open the stream" << std::endl;
+        return;
+    }
+
+    auto percentile = [&] (double p) { return samples[size_t(p * double(samples.size() - 1))]; };
+    std::cout << name << ": p50 = " << percentile(0.5) << " us, "
+              << "p90 = " << percentile(0.9) << " us, "
+              << "p99 = " << percentile(0.99) << " us" << std::endl;
+}
+
+static std::vector<double> run(const UsbEventLoopPool::Config& loopConfig,
+                               const DeviceManager::Config& config,
+                               size_t iterations,
+                               std::chrono::nanoseconds spin)
+{
+    auto manager = DeviceManager::make(UsbEventLoopPool::make(loopConfig), config);
+    manager->start();
+
+    auto device = manager->waitForAny(std::chrono::seconds(10));
+    if (!device)
+        return {};
+
+    return measure(*device, iterations, spin);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "You have to provide paths to private and public keys generated by adb keygen" << std::endl;
+        std::cerr << "(and optionally a CPU for the busy-poll loop and iteration count)" << std::endl;
+        return 1;
+    }
+
+    DeviceManager::Config config;
+    config.privateKeyPaths = {argv[1]};
+    config.publicKeyPath = argv[2];
+
+    int cpu = argc > 3 ? std::stoi(argv[3]) : 1;
+    size_t iterations = argc > 4 ? std::stoul(argv[4]) : 2000;
+
+    auto normal = run({1, {}, UsbEventLoop::BLOCKING}, config, iterations, std::chrono::nanoseconds(0));
+    report("blocking ", normal);
+
+    auto busy = run({1, {{cpu}}, UsbEventLoop::BUSY_POLL}, config, iterations, std::chrono::microseconds(50));
+    report("busy-poll", busy);
+
+    return 0;
+}
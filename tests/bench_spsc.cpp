@@ -0,0 +1,150 @@
+#include <APayload.hpp>
+#include <Parker.hpp>
+#include <SpscRing.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Payload handoff between the receive path and a reader, no device needed:
+// the former stream queue (deque + mutex + condition variable notified per payload)
+// against SpscRing + Parker (spin-then-futex).
+// Throughput: one thread pushes, another pops. Latency: ping-pong over two queues, half the round trip
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t CAPACITY = 256;
+
+// The queue AdbStreamBase used before
+class LockedQueue {
+public:
+    bool push(APayload&& payload)
+    {
+        std::unique_lock lock(mMutex);
+        mQueue.push_back(std::move(payload));
+        lock.unlock();
+        mReceived.notify_one();
+        return true;
+    }
+
+    APayload pop()
+    {
+        std::unique_lock lock(mMutex);
+        mReceived.wait(lock, [this] { return !mQueue.empty(); });
+        auto payload = std::move(mQueue.front());
+        mQueue.pop_front();
+        return payload;
+    }
+
+private:
+    std::deque<APayload> mQueue;
+    std::mutex mMutex;
+    std::condition_variable mReceived;
+};
+
+// The queue AdbStreamBase uses now
+class RingQueue {
+public:
+    bool push(APayload&& payload)
+    {
+        if (!mRing.tryPush(std::move(payload)))
+            return false;
+        mParker.notifyAll();
+        return true;
+    }
+
+    APayload pop()
+    {
+        while (true) {
+            if (auto payload = mRing.tryPop())
+                return std::move(*payload);
+            mParker.wait([this] { return !mRing.isEmpty(); });
+        }
+    }
+
+private:
+    SpscRing<APayload> mRing{CAPACITY};
+    Parker mParker;
+};
+
+static APayload makePayload(size_t size)
+{
+    APayload payload(size);
+    payload.setDataSize(size);
+    return payload;
+}
+
+template<class Queue>
+static double throughput(size_t count, size_t payloadSize)
+{
+    Queue queue;
+    std::vector<APayload> payloads;
+    payloads.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+        payloads.push_back(makePayload(payloadSize));
+
+    auto start = Clock::now();
+    std::thread consumer([&] {
+        for (size_t i = 0; i < count; ++i)
+            queue.pop();
+    });
+
+    // The ring is bounded: the receive path would hold OKAY back, here the producer retries
+    for (auto& payload : payloads)
+        while (!queue.push(std::move(payload)))
+            std::this_thread::yield();
+
+    consumer.join();
+    return double(count) / std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+template<class Queue>
+static std::vector<double> latency(size_t iterations)
+{
+    Queue there;
+    Queue back;
+
+    std::thread echo([&] {
+        for (size_t i = 0; i < iterations; ++i)
+            back.push(there.pop());
+    });
+
+    std::vector<double> samples;
+    samples.reserve(iterations);
+    auto payload = makePayload(1);
+    for (size_t i = 0; i < iterations; ++i) {
+        auto start = Clock::now();
+        there.push(std::move(payload));
+        payload = back.pop();
+        samples.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count() / 2);
+    }
+
+    echo.join();
+    std::sort(samples.begin(), samples.end());
+    return samples;
+}
+
+template<class Queue>
+static void run(const std::string& name, size_t count, size_t iterations)
+{
+    auto perSecond = throughput<Queue>(count, 64);
+    auto samples = latency<Queue>(iterations);
+    auto percentile = [&] (double p) { return samples[size_t(p * double(samples.size() - 1))]; };
+
+    std::cout << name << ": " << perSecond / 1e6 << " M payloads/s, handoff "
+              << "p50 = " << percentile(0.5) << " ns, "
+              << "p99 = " << percentile(0.99) << " ns" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::stoul(argv[1]) : 1'000'000;
+    size_t iterations = argc > 2 ? std::stoul(argv[2]) : 100'000;
+
+    run<LockedQueue>("deque + mutex + condition variable", count, iterations);
+    run<RingQueue>("SpscRing + Parker", count, iterations);
+    return 0;
+}
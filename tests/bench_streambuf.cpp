@@ -0,0 +1,118 @@
+#include <DeviceManager.hpp>
+#include <streams/AdbStreamBuf.hpp>
+
+#include <iostream>
+#include <istream>
+#include <ostream>
+
+// Bulk transfer through AdbStreamBuf compared with the per-payload operators.
+// Reading: `head -c` of /dev/zero on the device, writing: `cat > /dev/null`.
+// Both sides move data in 4 KiB application-sized blocks.
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t BLOCK_SIZE = 4096;
+
+static double mibPerSecond(size_t bytes, Clock::time_point start)
+{
+    return double(bytes) / std::chrono::duration<double>(Clock::now() - start).count() / (1024 * 1024);
+}
+
+static std::string readCommand(size_t total)
+{
+    return "exec:head -c " + std::to_string(total) + " /dev/zero";
+}
+
+static void readOperators(AdbDevice& device, size_t total)
+{
+    auto streams = device.open(readCommand(total));
+    if (!streams)
+        return;
+
+    auto start = Clock::now();
+    size_t received = 0;
+    std::string chunk;
+    while (received < total) {
+        streams->istream >> chunk;
+        if (chunk.empty())
+            break;
+        received += chunk.size();
+    }
+    std::cout << "read,  operator>>:   " << mibPerSecond(received, start) << " MiB/s" << std::endl;
+}
+
+static void readStreamBuf(AdbDevice& device, size_t total)
+{
+    auto streams = device.open(readCommand(total));
+    if (!streams)
+        return;
+
+    AdbStreamBuf buffer(std::move(streams->istream), std::move(streams->ostream), device.getMaxData());
+    std::istream in(&buffer);
+
+    auto start = Clock::now();
+    size_t received = 0;
+    char block[BLOCK_SIZE];
+    while (in.read(block, sizeof(block)) || in.gcount() > 0)
+        received += in.gcount();
+    std::cout << "read,  AdbStreamBuf: " << mibPerSecond(received, start) << " MiB/s" << std::endl;
+}
+
+static void writeOperators(AdbDevice& device, size_t total)
+{
+    auto streams = device.open("exec:cat > /dev/null");
+    if (!streams)
+        return;
+
+    std::string block(BLOCK_SIZE, 'x');
+    auto start = Clock::now();
+    for (size_t sent = block.size(); sent < total; sent += block.size())
+        streams->ostream << block; // a payload per block
+    streams->ostream.writeAsync(APayload(block)).get(); // payloads leave in order, the last one waits for all
+    std::cout << "write, operator<<:   " << mibPerSecond(total, start) << " MiB/s" << std::endl;
+}
+
+static void writeStreamBuf(AdbDevice& device, size_t total)
+{
+    auto streams = device.open("exec:cat > /dev/null");
+    if (!streams)
+        return;
+
+    AdbStreamBuf buffer(std::move(streams->istream), std::move(streams->ostream), device.getMaxData());
+    std::ostream out(&buffer);
+
+    std::string block(BLOCK_SIZE, 'x');
+    auto start = Clock::now();
+    for (size_t sent = 0; sent < total; sent += block.size())
+        out.write(block.data(), block.size());
+    out.flush();
+    std::cout << "write, AdbStreamBuf: " << mibPerSecond(total, start) << " MiB/s" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "You have to provide paths to private and public keys generated by adb keygen" << std::endl;
+        std::cerr << "(and optionally the amount of MiB to move)" << std::endl;
+        return 1;
+    }
+
+    DeviceManager::Config config;
+    config.privateKeyPaths = {argv[1]};
+    config.publicKeyPath = argv[2];
+    size_t total = (argc > 3 ? std::stoul(argv[3]) : 64) * 1024 * 1024;
+
+    auto manager = DeviceManager::make(UsbEventLoopPool::make({1, {}, UsbEventLoop::BLOCKING}), config);
+    manager->start();
+
+    auto device = manager->waitForAny(std::chrono::seconds(10));
+    if (!device) {
+        std::cerr << "No device" << std::endl;
+        return 1;
+    }
+
+    readOperators(*device, total);
+    readStreamBuf(*device, total);
+    writeOperators(*device, total);
+    writeStreamBuf(*device, total);
+    return 0;
+}
@@ -0,0 +1,144 @@
+#include <TcpTransport.hpp>
+#include <SmartSocket.hpp>
+
+#include <deque>
+#include <future>
+#include <iostream>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+// Loopback throughput of TcpTransport in plaintext and after the STLS upgrade.
+// The server side of the socket only counts the bytes, TLS server is another TlsSession.
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t WINDOW = 8; // packets in flight
+
+static uint16_t localPort(int fd)
+{
+    sockaddr_in address{};
+    socklen_t length = sizeof(address);
+    getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length);
+    return ntohs(address.sin_port);
+}
+
+// Reads total bytes, in TLS after the plaintext STLS packet if config is set
+static bool serve(int listenFd, size_t total, const Transport::TlsConfig* config)
+{
+    int fd = ::accept(listenFd, nullptr, nullptr);
+    if (fd < 0)
+        return false;
+
+    TlsSession::UniquePointer tls;
+    if (config) {
+        AMessage stls{};
+        tls = TlsSession::make(TlsSession::SERVER, *config, fd);
+        if (!SmartSocket::readFully(fd, &stls, sizeof(stls)) || !tls || !tls->handshake(std::chrono::seconds(10))) {
+            SmartSocket::close(fd);
+            return false;
+        }
+    }
+
+    std::vector<uint8_t> buffer(1024 * 1024);
+    size_t received = 0;
+    while (received < total) {
+        long res = 0;
+        if (tls) {
+            res = tls->read(buffer.data(), buffer.size());
+            if (res == 0) {
+                pollfd pollFd{fd, POLLIN, 0};
+                ::poll(&pollFd, 1, -1);
+                continue;
+            }
+        }
+        else {
+            res = ::recv(fd, buffer.data(), buffer.size(), 0);
+        }
+
+        if (res <= 0)
+            break;
+        received += res;
+    }
+
+    if (tls)
+        tls->closeNotify();
+    SmartSocket::close(fd);
+    return received == total;
+}
+
+static void run(const std::string& name, size_t count, size_t payloadSize, const Transport::TlsConfig* config)
+{
+    int listenFd = SmartSocket::listen({"127.0.0.1", 0, {}});
+    if (listenFd < 0) {
+        std::cerr << "Can't listen on loopback" << std::endl;
+        return;
+    }
+
+    auto total = count * (sizeof(AMessage) + payloadSize);
+    auto served = std::async(std::launch::async, serve, listenFd, total, config);
+
+    auto transport = TcpTransport::make("127.0.0.1", localPort(listenFd));
+    if (!transport) {
+        std::cerr << "Can't connect" << std::endl;
+        SmartSocket::close(listenFd);
+        return;
+    }
+
+    if (config) {
+        transport->send(APacket(AMessage::make(A_STLS, A_STLS_VERSION, 0)));
+        transport->startTls(*config);
+    }
+
+    APayload payload(payloadSize);
+    payload.setDataSize(payloadSize);
+    std::fill(payload.begin(), payload.end(), 'x');
+
+    auto start = Clock::now();
+    std::deque<std::future<Transport::ErrorCode>> window;
+    bool failed = false;
+    for (size_t i = 0; i < count && !failed; ++i) {
+        if (window.size() == WINDOW) {
+            failed = window.front().get() != Transport::OK;
+            window.pop_front();
+        }
+
+        APacket packet(AMessage::make(A_WRTE, 1, 1), payload);
+        packet.updateMessageDataLength();
+        window.push_back(transport->sendAsync(std::move(packet)));
+    }
+    for (auto& future : window)
+        failed |= future.get() != Transport::OK;
+
+    bool ok = !failed && served.get();
+    auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    SmartSocket::close(listenFd);
+
+    if (!ok) {
+        std::cout << name << ": failed" << std::endl;
+        return;
+    }
+
+    std::cout << name << ": " << double(total) / seconds / (1024 * 1024) << " MiB/s";
+    if (config)
+        std::cout << " (" << transport->getCiphersuite() << ")";
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "You have to provide paths to a certificate and its private key" << std::endl;
+        std::cerr << "(openssl req -x509 -key adbkey -new -subj /CN=adb -out adbkey.crt)" << std::endl;
+        std::cerr << "and optionally packet count and payload size" << std::endl;
+        return 1;
+    }
+
+    Transport::TlsConfig config{argv[1], argv[2]};
+    size_t count = argc > 3 ? std::stoul(argv[3]) : 4096;
+    size_t payloadSize = argc > 4 ? std::stoul(argv[4]) : 256 * 1024;
+
+    run("plaintext", count, payloadSize, nullptr);
+    run("TLS", count, payloadSize, &config);
+    return 0;
+}
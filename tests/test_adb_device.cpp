@@ -1,6 +1,7 @@
 #include <AdbDevice.hpp>
 #include <UsbTransport.hpp>
 
+#include <algorithm>
 #include <iostream>
 
 int main(int argc, char** argv) {
@@ -47,9 +48,8 @@ int main(int argc, char** argv) {
     device->addPrivateKeyPath(privateKey);
     device->setPublicKeyPath(publicKey);
 
-    // CONNECT TO THE DEVICE
-    device->connect();
-    if (!device->isConnected()) {
+    // CONNECT TO THE DEVICE (leave time to accept the key on the device)
+    if (!device->connect(std::chrono::seconds(30))) {
         std::cout << "Couldn't establish connection with the device." << std::endl;
         return 0;
     }
@@ -89,5 +89,17 @@ int main(int argc, char** argv) {
     in >> result;
     std::cout << "The input stream returned: \"" << result << '"' << std::endl;
 
+    // READ A BIGGER OUTPUT WITHOUT COPIES
+    auto listing = device->open("shell:ls -l /system/bin");
+    if (listing) {
+        size_t bytes = 0, lines = 0;
+        while (listing->istream.read([&](const uint8_t* data, size_t size) {
+            bytes += size;
+            lines += std::count(data, data + size, '\n');
+        }))
+            ;
+        std::cout << "ls -l /system/bin: " << lines << " lines, " << bytes << " bytes" << std::endl;
+    }
+
     return 0;
 }
@@ -0,0 +1,108 @@
+#include <AdbCoro.hpp>
+#include <DeviceManager.hpp>
+
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+
+// Coroutine version of test_poller: many shell streams, no thread blocked per stream.
+// Every stream is served by its own coroutine, all of them share a two-thread executor
+
+static AdbCoro::Task<size_t> runShell(AdbCoro::Executor& executor, AdbDevice::SharedPointer device, std::string command)
+{
+    auto streams = co_await AdbCoro::open(executor, device, "shell:" + command);
+    if (!streams)
+        co_return 0;
+
+    size_t bytes = 0;
+    while (auto payload = co_await AdbCoro::read(executor, streams->istream))
+        bytes += payload->getSize();
+    co_return bytes;
+}
+
+static AdbCoro::Task<void> echo(AdbCoro::Executor& executor, AdbDevice::SharedPointer device)
+{
+    auto streams = co_await AdbCoro::open(executor, device, "shell:cat");
+    if (!streams)
+        co_return;
+
+    auto error = co_await AdbCoro::write(executor, streams->ostream, APayload("hello from a coroutine\n"));
+    if (error != Transport::OK)
+        co_return;
+
+    if (auto payload = co_await AdbCoro::read(executor, streams->istream))
+        std::cout << "echo: " << payload->toStringView();
+}
+
+// Tasks are lazy: awaiting them one by one would run the shells in sequence, spawn them instead
+struct Results {
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t left = 0;
+    size_t bytes = 0;
+};
+
+static AdbCoro::Task<void> collect(AdbCoro::Executor& executor, AdbDevice::SharedPointer device,
+                                   std::string command, Results& results)
+{
+    auto bytes = co_await runShell(executor, std::move(device), std::move(command));
+
+    std::scoped_lock lock(results.mutex);
+    results.bytes += bytes;
+    if (--results.left == 0)
+        results.done.notify_one();
+}
+
+static AdbCoro::Task<bool> prepare(AdbCoro::Executor& executor, AdbDevice::SharedPointer device)
+{
+    auto state = co_await AdbCoro::connect(executor, device, std::chrono::seconds(10));
+    if (state < AdbDevice::BOOTLOADER) {
+        std::cout << "Device isn't connected: " << state << std::endl;
+        co_return false;
+    }
+
+    co_await echo(executor, device);
+    co_return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "You have to provide paths to private and public keys generated by adb keygen" << std::endl;
+        std::cerr << "(and optionally the number of streams)" << std::endl;
+        return 1;
+    }
+
+    DeviceManager::Config config;
+    config.privateKeyPaths = {argv[1]};
+    config.publicKeyPath = argv[2];
+    size_t count = argc > 3 ? std::stoul(argv[3]) : 100;
+
+    auto manager = DeviceManager::make(UsbEventLoopPool::make({1, {}, UsbEventLoop::BLOCKING}), config);
+    manager->start();
+    if (!manager->waitForAny(std::chrono::seconds(10))) {
+        std::cerr << "No device" << std::endl;
+        return 1;
+    }
+
+    AdbCoro::Executor executor(2);
+    auto device = manager->getDevices().front();
+    if (!AdbCoro::syncWait(executor, prepare(executor, device)))
+        return 1;
+
+    Results results;
+    results.left = count;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        auto command = "sleep " + std::to_string(i % 5) + "; echo " + std::to_string(i);
+        AdbCoro::spawn(executor, collect(executor, device, std::move(command), results));
+    }
+
+    std::unique_lock lock(results.mutex);
+    results.done.wait(lock, [&] { return results.left == 0; });
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Read " << results.bytes << " bytes from " << count << " streams in " << elapsed << " s" << std::endl;
+    lock.unlock();
+
+    executor.stop();
+    return 0;
+}
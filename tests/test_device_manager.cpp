@@ -0,0 +1,58 @@
+#include <DeviceManager.hpp>
+
+#include <iostream>
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "You have to provide paths to private and public keys generated by adb keygen" << std::endl;
+        std::cerr << "(and optionally a serial of the device to wait for)" << std::endl;
+        return 1;
+    }
+
+    // Library-owned event loops, devices are sharded across them
+    auto loops = UsbEventLoopPool::make(2);
+
+    DeviceManager::Config config;
+    config.privateKeyPaths = {argv[1]};
+    config.publicKeyPath = argv[2];
+
+    auto manager = DeviceManager::make(loops, config);
+    manager->setAttachListener([] (const AdbDevice::SharedPointer& device) {
+        std::cout << " + " << device->getSerial() << " (" << device->getModel() << ")" << std::endl;
+    });
+    manager->setDetachListener([] (const AdbDevice::SharedPointer& device) {
+        std::cout << " - " << device->getSerial() << std::endl;
+    });
+
+    if (!manager->start())
+        std::cout << "Hotplug isn't supported, only present devices are attached" << std::endl;
+
+    std::cout << "Waiting for devices..." << std::endl;
+    AdbDevice::SharedPointer device;
+    if (argc > 3)
+        device = manager->waitForDevice(argv[3], std::chrono::seconds(10));
+    else
+        device = manager->waitForAny(std::chrono::seconds(10));
+
+    if (!device) {
+        std::cout << "No device appeared in 10 seconds" << std::endl;
+        return 0;
+    }
+
+    std::cout << "Got device " << device->getSerial() << std::endl;
+    std::cout << "Lookup by serial: " << std::boolalpha << (manager->find(device->getSerial()) == device) << std::endl;
+
+    std::cout << "Devices: " << manager->getDeviceCount() << std::endl;
+    for (const auto& attached : manager->getDevices())
+        std::cout << "\t* " << attached->getSerial() << std::endl;
+
+    std::cout << "Press Enter to exit (try replugging devices meanwhile)" << std::endl;
+    std::cin.get();
+
+    auto utilization = loops->sampleUtilization();
+    for (size_t i = 0; i < utilization.size(); ++i)
+        std::cout << "Loop " << i << " utilization: " << utilization[i] * 100 << "%" << std::endl;
+
+    manager->stop();
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include <DeviceManager.hpp>
+#include <ForwardEngine.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+// Forwards a local port to a service on the device and prints throughput every second, e.g.:
+//   test_forward adbkey adbkey.pub 27184 tcp:27184
+// then connect to localhost:27184 (on the device: nc -l -p 27184 < /dev/zero)
+int main(int argc, char** argv) {
+    if (argc < 5) {
+        std::cerr << "Usage: test_forward <private key> <public key> <local port> <device service>" << std::endl;
+        return 1;
+    }
+
+    DeviceManager::Config config;
+    config.privateKeyPaths = {argv[1]};
+    config.publicKeyPath = argv[2];
+
+    auto manager = DeviceManager::make(ObjLibusbContext::make(), config);
+    manager->start();
+
+    auto device = manager->waitForAny(std::chrono::seconds(10));
+    if (!device) {
+        std::cout << "No device appeared in 10 seconds" << std::endl;
+        return 0;
+    }
+
+    auto engine = ForwardEngine::make();
+    auto id = engine->forward(device, static_cast<uint16_t>(std::stoi(argv[3])), argv[4]);
+    if (!id) {
+        std::cout << "Couldn't listen on port " << argv[3] << std::endl;
+        return 0;
+    }
+    std::cout << "localhost:" << *engine->getLocalPort(*id) << " -> " << argv[4] << std::endl;
+
+    ForwardEngine::Counters last{};
+    for (int second = 0; second < 60; ++second) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        auto counters = engine->getCounters(*id);
+        if (!counters)
+            break;
+
+        std::cout << "connections: " << counters->activeConnections << "/" << counters->acceptedConnections
+                  << " (" << counters->failedOpens << " refused)"
+                  << ", to device: " << (counters->bytesToDevice - last.bytesToDevice) / (1 << 20) << " MiB/s"
+                  << ", from device: " << (counters->bytesFromDevice - last.bytesFromDevice) / (1 << 20) << " MiB/s"
+                  << std::endl;
+        last = *counters;
+    }
+
+    engine->stop();
+    manager->stop();
+    return 0;
+}
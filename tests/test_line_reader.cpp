@@ -0,0 +1,99 @@
+#include <DeviceManager.hpp>
+#include <streams/AdbLineReader.hpp>
+#include <utils.hpp>
+
+#include <iostream>
+
+// Lines of a big text output: AdbLineReader against operator>>(std::string&) + utils::tokenize.
+// Both runs should count the same non-empty lines
+
+using Clock = std::chrono::steady_clock;
+
+static void report(const std::string& name, size_t lines, size_t bytes, Clock::time_point start)
+{
+    auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::cout << name << ": " << lines << " lines, " << bytes << " bytes in " << seconds * 1000 << " ms" << std::endl;
+}
+
+static void withTokenize(AdbDevice& device, const std::string& command)
+{
+    auto streams = device.open(command);
+    if (!streams)
+        return;
+
+    auto start = Clock::now();
+    size_t lines = 0;
+    size_t bytes = 0;
+    std::string carry;
+    while (true) {
+        std::string chunk;
+        streams->istream >> chunk;
+        if (chunk.empty())
+            break;
+
+        // Lines cut at the payload's end are carried over by hand
+        chunk.insert(0, carry);
+        auto end = chunk.rfind('\n');
+        carry = end == std::string::npos ? chunk : chunk.substr(end + 1);
+        if (end == std::string::npos)
+            continue;
+
+        for (auto line : utils::tokenize(std::string_view(chunk).substr(0, end), "\n")) {
+            if (line.empty())
+                continue;
+            ++lines;
+            bytes += line.size();
+        }
+    }
+    if (!carry.empty()) {
+        ++lines;
+        bytes += carry.size();
+    }
+
+    report("operator>> + tokenize", lines, bytes, start);
+}
+
+static void withLineReader(AdbDevice& device, const std::string& command)
+{
+    auto streams = device.open(command);
+    if (!streams)
+        return;
+
+    auto start = Clock::now();
+    size_t lines = 0;
+    size_t bytes = 0;
+    AdbLineReader reader(streams->istream, '\n', false);
+    while (auto line = reader.next()) {
+        if (line->empty())
+            continue;
+        ++lines;
+        bytes += line->size();
+    }
+
+    report("AdbLineReader", lines, bytes, start);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "You have to provide paths to private and public keys generated by adb keygen" << std::endl;
+        std::cerr << "(and optionally a command, `exec:dumpsys package` by default)" << std::endl;
+        return 1;
+    }
+
+    DeviceManager::Config config;
+    config.privateKeyPaths = {argv[1]};
+    config.publicKeyPath = argv[2];
+    std::string command = argc > 3 ? argv[3] : "exec:dumpsys package";
+
+    auto manager = DeviceManager::make(UsbEventLoopPool::make({1, {}, UsbEventLoop::BLOCKING}), config);
+    manager->start();
+    if (!manager->waitForAny(std::chrono::seconds(10))) {
+        std::cerr << "No device" << std::endl;
+        return 1;
+    }
+
+    auto device = manager->getDevices().front();
+    withTokenize(*device, command);
+    withLineReader(*device, command);
+    return 0;
+}
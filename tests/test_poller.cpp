@@ -0,0 +1,64 @@
+#include <DeviceManager.hpp>
+#include <streams/AdbStreamPoller.hpp>
+
+#include <iostream>
+
+// One thread serves many shell streams of all connected devices through AdbStreamPoller
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "You have to provide paths to private and public keys generated by adb keygen" << std::endl;
+        std::cerr << "(and optionally the number of streams per device)" << std::endl;
+        return 1;
+    }
+
+    DeviceManager::Config config;
+    config.privateKeyPaths = {argv[1]};
+    config.publicKeyPath = argv[2];
+    size_t perDevice = argc > 3 ? std::stoul(argv[3]) : 100;
+
+    auto manager = DeviceManager::make(UsbEventLoopPool::make({1, {}, UsbEventLoop::BLOCKING}), config);
+    manager->start();
+    if (!manager->waitForAny(std::chrono::seconds(10))) {
+        std::cerr << "No device" << std::endl;
+        return 1;
+    }
+
+    // Every stream sleeps for a while and prints its number
+    std::vector<std::string> destinations;
+    for (size_t i = 0; i < perDevice; ++i)
+        destinations.push_back("shell:sleep " + std::to_string(i % 5) + "; echo " + std::to_string(i));
+
+    std::vector<AdbIStream> streams;
+    for (const auto& device : manager->getDevices())
+        for (auto& opened : device->openMany(destinations))
+            if (opened)
+                streams.push_back(std::move(opened->istream));
+
+    AdbStreamPoller poller;
+    for (size_t i = 0; i < streams.size(); ++i)
+        poller.add(streams[i], i);
+    std::cout << "Polling " << poller.size() << " streams" << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    while (poller.size() > 0) {
+        auto ready = poller.wait(std::chrono::seconds(10));
+        if (ready.empty()) {
+            std::cout << "Timed out, " << poller.size() << " streams left" << std::endl;
+            break;
+        }
+
+        for (auto key : ready) {
+            auto& stream = streams[key];
+            while (auto payload = stream.tryRead())
+                std::cout << "stream " << key << ": " << payload->toStringView();
+
+            if (!stream.isOpen() && stream.isEmpty())
+                poller.remove(key);
+        }
+    }
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Done in " << elapsed << " s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <DeviceManager.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+// Log collector: logcat of every connected device handled right on the event thread, in reactor mode.
+// No reader threads, no queues
+
+struct Collected {
+    std::atomic<size_t> bytes{0};
+    std::atomic<size_t> lines{0};
+    std::atomic<size_t> closed{0};
+};
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "You have to provide paths to private and public keys generated by adb keygen" << std::endl;
+        std::cerr << "(and optionally the number of seconds to collect for)" << std::endl;
+        return 1;
+    }
+
+    DeviceManager::Config config;
+    config.privateKeyPaths = {argv[1]};
+    config.publicKeyPath = argv[2];
+    auto seconds = argc > 3 ? std::stoul(argv[3]) : 10;
+
+    auto manager = DeviceManager::make(UsbEventLoopPool::make({1, {}, UsbEventLoop::BLOCKING}), config);
+    manager->start();
+    if (!manager->waitForAny(std::chrono::seconds(10))) {
+        std::cerr << "No device" << std::endl;
+        return 1;
+    }
+
+    Collected collected;
+    std::mutex streamsMutex;
+    std::vector<AdbDevice::Streams> streams; // dropping them would close the streams
+
+    auto devices = manager->getDevices();
+    for (const auto& device : devices) {
+        AdbStreamBase::Handlers handlers;
+        handlers.onData = [&collected] (APayload&& payload) {
+            auto view = payload.toStringView();
+            collected.bytes += view.size();
+            collected.lines += std::count(view.begin(), view.end(), '\n');
+        };
+        handlers.onClose = [&collected] {
+            ++collected.closed;
+        };
+
+        device->openAsync("shell:logcat -v brief", std::move(handlers), [&] (std::optional<AdbDevice::Streams> opened) {
+            if (!opened)
+                return;
+            std::scoped_lock lock(streamsMutex);
+            streams.push_back(std::move(*opened));
+        });
+    }
+
+    for (unsigned long i = 0; i < seconds; ++i) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        std::cout << collected.lines << " lines, " << collected.bytes << " bytes from "
+                  << devices.size() << " devices, " << collected.closed << " closed" << std::endl;
+    }
+
+    std::scoped_lock lock(streamsMutex);
+    streams.clear();
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include <DeviceManager.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+// Receives data over adb reverse. Run on the device while the test waits:
+//   adb shell "head -c 500000000 /dev/zero | nc localhost 27183"
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "You have to provide paths to private and public keys generated by adb keygen" << std::endl;
+        return 1;
+    }
+
+    DeviceManager::Config config;
+    config.privateKeyPaths = {argv[1]};
+    config.publicKeyPath = argv[2];
+
+    auto manager = DeviceManager::make(ObjLibusbContext::make(), config);
+    manager->start();
+
+    auto device = manager->waitForAny(std::chrono::seconds(10));
+    if (!device) {
+        std::cout << "No device appeared in 10 seconds" << std::endl;
+        return 0;
+    }
+    std::cout << "Got device " << device->getSerial() << std::endl;
+
+    std::atomic<size_t> connections = 0;
+    bool ok = device->reverse("tcp:27183", "tcp:27183", [&connections](const std::string& destination,
+                                                                       AdbDevice::Streams streams) {
+        // The handler runs on the event thread, the stream is drained elsewhere
+        auto id = ++connections;
+        std::cout << "Connection #" << id << " to " << destination << std::endl;
+        std::thread([id, istream = std::move(streams.istream)]() mutable {
+            auto start = std::chrono::steady_clock::now();
+            size_t bytes = 0;
+            APayload payload{0};
+            while (istream.isOpen() || !istream.isEmpty()) {
+                istream >> payload;
+                bytes += payload.getSize();
+            }
+
+            std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+            std::cout << "Connection #" << id << ": " << bytes << " bytes, "
+                      << bytes / seconds.count() / (1 << 20) << " MiB/s" << std::endl;
+        }).detach();
+    });
+
+    if (!ok) {
+        std::cout << "Device refused reverse:forward" << std::endl;
+        return 0;
+    }
+
+    std::cout << "Reverse tcp:27183 is set up, press Enter to remove it and exit" << std::endl;
+    std::cin.get();
+
+    device->removeReverse("tcp:27183", "tcp:27183");
+    manager->stop();
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include <AdbServer.hpp>
+
+#include <iostream>
+
+#include <sys/socket.h>
+
+// Runs AdbServer in-process and talks to it like an adb client would.
+// Works without devices, with devices attached it also checks queries and service passthrough.
+// usage: test_server [port] [private key] [public key]
+
+static int failures = 0;
+
+static void check(const std::string& name, bool ok)
+{
+    std::cout << (ok ? "[ OK ] " : "[FAIL] ") << name << std::endl;
+    if (!ok)
+        ++failures;
+}
+
+int main(int argc, char** argv) {
+    uint16_t port = argc > 1 ? static_cast<uint16_t>(std::stoul(argv[1])) : 15037;
+    auto endpoint = SmartSocket::Endpoint::local(port);
+
+    DeviceManager::Config config;
+    if (argc > 3) {
+        config.privateKeyPaths = {argv[2]};
+        config.publicKeyPath = argv[3];
+    }
+
+    auto manager = DeviceManager::make(UsbEventLoopPool::make(1), config);
+    manager->start();
+    manager->waitForAny(std::chrono::seconds(3));
+
+    auto server = AdbServer::make(*manager, endpoint);
+    if (!server) {
+        std::cerr << "Couldn't start the server on port " << port << std::endl;
+        return 1;
+    }
+
+    auto version = SmartSocket::query(endpoint, "host:version");
+    check("host:version", version && *version == "0029");
+
+    auto devices = SmartSocket::query(endpoint, "host:devices-l");
+    check("host:devices-l", devices.has_value());
+    auto parsed = SmartSocket::parseDevices(devices.value_or(""));
+    check("device count matches", parsed.size() == manager->getDeviceCount());
+
+    std::string failMessage;
+    int fd = SmartSocket::request(endpoint, "host:transport:no-such-device", &failMessage);
+    check("unknown serial is rejected", fd < 0 && !failMessage.empty());
+    SmartSocket::close(fd);
+
+    fd = SmartSocket::request(endpoint, "host:unknown-request", &failMessage);
+    check("unknown request is rejected", fd < 0);
+    SmartSocket::close(fd);
+
+    for (const auto& info : parsed) {
+        auto features = SmartSocket::query(endpoint, "host-serial:" + info.serial + ":features");
+        check(info.serial + ": features", features.has_value());
+
+        fd = SmartSocket::request(endpoint, "host:transport:" + info.serial);
+        check(info.serial + ": transport", fd >= 0);
+        if (fd < 0)
+            continue;
+
+        bool opened = SmartSocket::sendRequest(fd, "shell:echo hello") && SmartSocket::readStatus(fd);
+        check(info.serial + ": shell service", opened);
+
+        std::string output;
+        char buffer[256];
+        while (opened) {
+            auto received = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (received <= 0)
+                break;
+            output.append(buffer, received);
+        }
+        check(info.serial + ": shell output \"" + output.substr(0, output.find('\n')) + "\"",
+              output.rfind("hello", 0) == 0);
+        SmartSocket::close(fd);
+    }
+
+    fd = SmartSocket::request(endpoint, "host:kill");
+    check("host:kill", fd >= 0);
+    SmartSocket::close(fd);
+    server->wait();
+    check("server stopped", !server->isRunning());
+
+    std::cout << (failures == 0 ? "All checks passed" : std::to_string(failures) + " check(s) failed") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
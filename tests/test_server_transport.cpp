@@ -0,0 +1,54 @@
+#include <AdbDevice.hpp>
+#include <AdbServerTransport.hpp>
+
+#include <iostream>
+
+// Requires a running adb server (adb start-server) with at least one device
+
+int main(int argc, char** argv) {
+    auto endpoint = SmartSocket::Endpoint::local();
+
+    auto devices = AdbServerTransport::listDevices(endpoint);
+    if (devices.empty()) {
+        std::cout << "adb server isn't running or has no devices" << std::endl;
+        return 0;
+    }
+
+    for (const auto& info : devices)
+        std::cout << "\t* " << info.serial << " " << info.state << std::endl;
+
+    std::string serial = argc > 1 ? argv[1] : devices.front().serial;
+    auto transport = AdbServerTransport::make(serial);
+    if (!transport) {
+        std::cout << "Couldn't create the transport" << std::endl;
+        return 1;
+    }
+
+    auto device = AdbDevice::make(std::move(transport));
+    device->connect();
+    if (!device->isConnected()) {
+        std::cout << "Couldn't connect to " << serial << " through the server" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Connected to " << device->getSerial() << " (" << device->getModel() << ")" << std::endl;
+
+    // Several streams at once, each one takes a pooled server connection
+    std::vector<AdbDevice::Streams> streams;
+    for (int i = 0; i < 8; ++i) {
+        auto opened = device->open("shell:echo stream " + std::to_string(i));
+        if (!opened) {
+            std::cout << "Couldn't open stream " << i << std::endl;
+            return 1;
+        }
+        streams.push_back(std::move(*opened));
+    }
+
+    for (auto& stream : streams) {
+        std::string result;
+        stream.istream >> result;
+        std::cout << "The input stream returned: \"" << result << '"' << std::endl;
+    }
+
+    return 0;
+}
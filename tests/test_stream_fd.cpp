@@ -0,0 +1,117 @@
+#include <DeviceManager.hpp>
+#include <ForwardEngine.hpp>
+#include <streams/AdbStreamFd.hpp>
+
+#include <fcntl.h>
+#include <iostream>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+// ADB streams in a plain epoll loop (AdbStreamFd), then a stream spliced into /dev/null (ForwardEngine::attach)
+
+using Clock = std::chrono::steady_clock;
+
+static void pollShells(AdbDevice& device, size_t count)
+{
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    std::vector<AdbStreamFd::UniquePointer> streams;
+    for (size_t i = 0; i < count; ++i) {
+        auto opened = device.open("shell:sleep " + std::to_string(i % 3) + "; echo " + std::to_string(i));
+        if (!opened)
+            continue;
+
+        auto stream = AdbStreamFd::make(std::move(*opened));
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = streams.size();
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, stream->getReadFd(), &event);
+        streams.push_back(std::move(stream));
+    }
+
+    size_t open = streams.size();
+    epoll_event events[64];
+    while (open > 0) {
+        int ready = epoll_wait(epollFd, events, 64, 10'000);
+        if (ready <= 0) {
+            std::cout << "Timed out, " << open << " streams left" << std::endl;
+            break;
+        }
+
+        for (int i = 0; i < ready; ++i) {
+            auto& stream = streams[events[i].data.u64];
+            while (auto payload = stream->tryRead())
+                std::cout << "stream " << events[i].data.u64 << ": " << payload->toStringView();
+
+            if (!stream->isOpen()) {
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, stream->getReadFd(), nullptr);
+                --open;
+            }
+        }
+    }
+
+    ::close(epollFd);
+}
+
+static void spliceToNull(const AdbDevice::SharedPointer& device, ForwardEngine& engine, size_t total)
+{
+    auto streams = device->open("exec:head -c " + std::to_string(total) + " /dev/zero");
+    if (!streams)
+        return;
+
+    int fd = engine.attach(device, std::move(*streams));
+    int pipeFds[2];
+    int null = ::open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (fd < 0 || pipe2(pipeFds, O_CLOEXEC) != 0 || null < 0) {
+        std::cout << "Couldn't set up the pipeline" << std::endl;
+        return;
+    }
+
+    // socket -> pipe -> file, the bytes never come back to userspace
+    auto start = Clock::now();
+    size_t moved = 0;
+    while (true) {
+        auto spliced = splice(fd, nullptr, pipeFds[1], nullptr, 1 << 20, SPLICE_F_MOVE);
+        if (spliced <= 0)
+            break;
+        while (spliced > 0) {
+            auto out = splice(pipeFds[0], nullptr, null, nullptr, spliced, SPLICE_F_MOVE);
+            if (out <= 0)
+                break;
+            spliced -= out;
+            moved += out;
+        }
+    }
+
+    auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::cout << "Spliced " << moved << " bytes, " << double(moved) / seconds / (1024 * 1024) << " MiB/s" << std::endl;
+    ::close(null);
+    ::close(pipeFds[0]);
+    ::close(pipeFds[1]);
+    ::close(fd);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "You have to provide paths to private and public keys generated by adb keygen" << std::endl;
+        return 1;
+    }
+
+    DeviceManager::Config config;
+    config.privateKeyPaths = {argv[1]};
+    config.publicKeyPath = argv[2];
+
+    auto manager = DeviceManager::make(UsbEventLoopPool::make({1, {}, UsbEventLoop::BLOCKING}), config);
+    manager->start();
+    if (!manager->waitForAny(std::chrono::seconds(10))) {
+        std::cerr << "No device" << std::endl;
+        return 1;
+    }
+
+    auto device = manager->getDevices().front();
+    pollShells(*device, 20);
+
+    auto engine = ForwardEngine::make();
+    if (engine)
+        spliceToNull(device, *engine, 64 * 1024 * 1024);
+    return 0;
+}
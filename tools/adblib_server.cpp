@@ -0,0 +1,39 @@
+#include <AdbServer.hpp>
+
+#include <iostream>
+
+// adb server replacement: serves devices found by DeviceManager over the host protocol
+// usage: adblib_server <private key> <public key> [port] [event loops]
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " <private key> <public key> [port] [event loops]" << std::endl;
+        return 1;
+    }
+
+    uint16_t port = argc > 3 ? static_cast<uint16_t>(std::stoul(argv[3])) : SmartSocket::DEFAULT_PORT;
+    size_t loopCount = argc > 4 ? std::stoul(argv[4]) : std::max(1u, std::thread::hardware_concurrency() / 2);
+
+    DeviceManager::Config config;
+    config.privateKeyPaths = {argv[1]};
+    config.publicKeyPath = argv[2];
+    config.workerCount = 8;
+
+    auto manager = DeviceManager::make(UsbEventLoopPool::make(loopCount), config);
+    manager->setAttachListener([] (const AdbDevice::SharedPointer& device) {
+        std::cout << "attached: " << device->getSerial() << std::endl;
+    });
+    manager->setDetachListener([] (const AdbDevice::SharedPointer& device) {
+        std::cout << "detached: " << device->getSerial() << std::endl;
+    });
+    manager->start();
+
+    auto server = AdbServer::make(*manager, SmartSocket::Endpoint::local(port));
+    if (!server)
+        return 1;
+
+    std::cout << "listening on 127.0.0.1:" << port << " with " << loopCount << " event loop(s)" << std::endl;
+    server->wait(); // until host:kill
+
+    return 0;
+}